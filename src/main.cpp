@@ -2,10 +2,22 @@
 #include <chrono>
 #include <thread>
 #include <cstring>
+#include <cmath>
 #include <map>
+#include <list>
+#include <deque>
+#include <unordered_map>
 #include <filesystem>
 #include <fstream>
 #include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <cstdlib>
+#include <cctype>
+#include <new>
+#include <utility>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -33,280 +45,4674 @@ extern "C" {
 #include <libavutil/time.h>
 }
 
-// Phase 5: Video decoder using FFmpeg
-class VideoDecoder {
+// Phase 22: Debug heap counter (configure with -DVIVALUX_ALLOC_TRACKING=ON).
+// Replaces global operator new and counts calls per thread role, so steady-state
+// playback can be checked for allocations on the render and decode threads.
+// FFmpeg's own av_malloc() traffic is not seen here.
+enum class AllocRole { Other = 0, Render = 1, Decode = 2 };
+
+#ifdef VIVALUX_ALLOC_TRACKING
+constexpr bool kAllocTracking = true;
+static thread_local AllocRole alloc_role = AllocRole::Other;
+static std::atomic<uint64_t> alloc_counts[3];
+
+void* operator new(size_t size) {
+    alloc_counts[(int)alloc_role].fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+inline void set_alloc_role(AllocRole role) { alloc_role = role; }
+inline uint64_t alloc_count(AllocRole role) { return alloc_counts[(int)role].load(std::memory_order_relaxed); }
+#else
+constexpr bool kAllocTracking = false;
+inline void set_alloc_role(AllocRole) {}
+inline uint64_t alloc_count(AllocRole) { return 0; }
+#endif
+
+// Phase 10: Lock-free single-producer/single-consumer ring.
+// The decode thread is the only writer and the render loop the only reader;
+// slots are preallocated so neither side ever allocates or blocks.
+// Phase 15: a popped slot can stay owned by the consumer (e.g. while the GPU
+// still reads it) until it is retired; the producer only reuses retired slots.
+template <typename T>
+class SpscRing {
 public:
-    AVFormatContext* fmt_ctx = nullptr;
-    AVCodecContext* codec_ctx = nullptr;
-    SwsContext* sws_ctx = nullptr;
-    AVFrame* frame = nullptr;
-    AVFrame* frame_rgb = nullptr;
-    int video_stream_idx = -1;
+    void reset(size_t capacity) {
+        slots.clear();
+        slots.resize(capacity);
+        read_idx.store(0, std::memory_order_relaxed);
+        write_idx.store(0, std::memory_order_relaxed);
+        retire_idx.store(0, std::memory_order_relaxed);
+    }
+
+    size_t capacity() const { return slots.size(); }
+
+    size_t size() const {
+        return write_idx.load(std::memory_order_acquire) - read_idx.load(std::memory_order_acquire);
+    }
+
+    // Phase 15: when set, pop() leaves slots to be handed back by retire_completed()
+    void set_deferred_retire(bool deferred) { deferred_retire = deferred; }
+
+    // Producer: returns the slot to fill, or nullptr if the ring is full
+    T* begin_push() {
+        if (slots.empty()) return nullptr;
+        size_t w = write_idx.load(std::memory_order_relaxed);
+        if (w - retire_idx.load(std::memory_order_acquire) >= slots.size()) return nullptr;
+        return &slots[w % slots.size()];
+    }
+
+    // Producer: publishes the slot returned by begin_push()
+    void end_push() {
+        write_idx.store(write_idx.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Producer-side access to any slot, used once up front to size buffers
+    T& slot(size_t i) { return slots[i]; }
+
+    // Consumer: oldest published slot, or nullptr if empty
+    T* front() {
+        size_t r = read_idx.load(std::memory_order_relaxed);
+        if (r == write_idx.load(std::memory_order_acquire)) return nullptr;
+        return &slots[r % slots.size()];
+    }
+
+    // Consumer: i-th queued slot counting from the front, or nullptr past the end
+    T* peek(size_t i) {
+        size_t r = read_idx.load(std::memory_order_relaxed);
+        if (i >= write_idx.load(std::memory_order_acquire) - r) return nullptr;
+        return &slots[(r + i) % slots.size()];
+    }
+
+    // Consumer: newest published slot, or nullptr if empty
+    T* back() {
+        size_t w = write_idx.load(std::memory_order_acquire);
+        if (w == read_idx.load(std::memory_order_relaxed)) return nullptr;
+        return &slots[(w - 1) % slots.size()];
+    }
+
+    // Consumer: takes the front slot out of the queue
+    void pop() {
+        size_t r = read_idx.load(std::memory_order_relaxed) + 1;
+        read_idx.store(r, std::memory_order_release);
+        if (!deferred_retire) retire_idx.store(r, std::memory_order_release);
+    }
+
+    // Phase 15: Consumer: hands popped slots back to the producer, oldest first,
+    // for as long as `done(slot)` says the slot is no longer in use
+    template <typename Fn>
+    void retire_completed(Fn&& done) {
+        size_t r = read_idx.load(std::memory_order_relaxed);
+        size_t t = retire_idx.load(std::memory_order_relaxed);
+        while (t != r && done(slots[t % slots.size()])) ++t;
+        retire_idx.store(t, std::memory_order_release);
+    }
+
+private:
+    std::vector<T> slots;
+    bool deferred_retire = false;
+    alignas(64) std::atomic<size_t> read_idx{0};
+    alignas(64) std::atomic<size_t> write_idx{0};
+    alignas(64) std::atomic<size_t> retire_idx{0};
+};
+
+// Phase 13: How a decoded frame's pixels are laid out for upload. YUV layouts
+// are uploaded plane by plane and converted to RGB in the fragment shader.
+enum class FrameLayout { RGBA, YUV420P, NV12 };
+
+inline int layout_plane_count(FrameLayout layout) {
+    switch (layout) {
+        case FrameLayout::YUV420P: return 3;
+        case FrameLayout::NV12: return 2;
+        default: return 1;
+    }
+}
+
+// Width, height and bytes per pixel of one plane of a width x height frame
+inline void layout_plane_size(FrameLayout layout, int plane, int width, int height, int& w, int& h, int& bpp) {
+    w = width;
+    h = height;
+    bpp = 1;
+    if (layout == FrameLayout::RGBA) {
+        bpp = 4;
+    } else if (plane > 0) {
+        w = (width + 1) / 2;
+        h = (height + 1) / 2;
+        if (layout == FrameLayout::NV12) bpp = 2;  // Interleaved UV
+    }
+}
+
+inline size_t layout_frame_bytes(FrameLayout layout, int width, int height) {
+    size_t total = 0;
+    for (int p = 0; p < layout_plane_count(layout); ++p) {
+        int w, h, bpp;
+        layout_plane_size(layout, p, width, height, w, h, bpp);
+        total += (size_t)w * h * bpp;
+    }
+    return total;
+}
+
+// Phase 10: A converted frame waiting in the decode ring
+struct DecodedFrame {
+    std::vector<uint8_t> storage;  // Pixels for all planes, sized once when the decoder opens
+    uint8_t* planes[3] = {nullptr, nullptr, nullptr};
+    int strides[3] = {0, 0, 0};    // Bytes per row of each plane
+    FrameLayout layout = FrameLayout::RGBA;
     int width = 0, height = 0;
-    int total_frames = 0;
-    int current_frame = 0;
-    uint8_t* buffer = nullptr;
-    
-    ~VideoDecoder() { cleanup(); }
-    
-    void cleanup() {
-        if (buffer) av_free(buffer);
-        if (frame) av_frame_free(&frame);
-        if (frame_rgb) av_frame_free(&frame_rgb);
-        if (sws_ctx) sws_freeContext(sws_ctx);
-        if (codec_ctx) avcodec_free_context(&codec_ctx);
-        if (fmt_ctx) avformat_close_input(&fmt_ctx);
+    int frame_index = 0;
+    double pts_seconds = 0.0;
+    int serial = 0;  // Seek generation; frames from an older generation are dropped
+    GLsync upload_fence = nullptr;  // Phase 15: set while the GPU reads a mapped slot
+
+    // Phase 13: Point the planes at tightly packed rows inside `base`
+    void set_packed_planes(uint8_t* base) {
+        for (int p = 0; p < 3; ++p) {
+            planes[p] = nullptr;
+            strides[p] = 0;
+        }
+        for (int p = 0; p < layout_plane_count(layout); ++p) {
+            int w, h, bpp;
+            layout_plane_size(layout, p, width, height, w, h, bpp);
+            planes[p] = base;
+            strides[p] = w * bpp;
+            base += (size_t)strides[p] * h;
+        }
     }
-    
-    bool open(const std::string& path) {
-        cleanup();
-        
-        // Open file
-        if (avformat_open_input(&fmt_ctx, path.c_str(), nullptr, nullptr) < 0) {
-            std::cerr << "Cannot open file: " << path << "\n";
+
+    // Copies pixels and timing from a frame of the same layout and size
+    void copy_from(const DecodedFrame& src) {
+        for (int p = 0; p < layout_plane_count(layout); ++p) {
+            int w, h, bpp;
+            layout_plane_size(layout, p, width, height, w, h, bpp);
+            av_image_copy_plane(planes[p], strides[p], src.planes[p], src.strides[p], w * bpp, h);
+        }
+        frame_index = src.frame_index;
+        pts_seconds = src.pts_seconds;
+    }
+};
+
+// Phase 10: Counters shared between the decode thread and the UI
+struct DecodeStats {
+    std::atomic<uint64_t> frames_decoded{0};
+    std::atomic<float> last_decode_ms{0.0f};
+    std::atomic<float> last_convert_ms{0.0f};  // Phase 15: sws/plane copy into the slot
+    uint64_t underruns = 0;       // Render loop wanted a frame but the ring was empty
+    uint64_t frames_dropped = 0;  // Decoded frames skipped because the clock had passed them
+    uint64_t frames_repeated = 0; // Output frames that re-showed the previous video frame
+    std::atomic<float> last_seek_ms{0.0f};  // Phase 12: seek request to target frame decoded
+    std::atomic<float> max_seek_ms{0.0f};
+    std::atomic<uint32_t> seeks{0};
+    std::atomic<uint32_t> last_seek_decoded{0};  // Frames decoded forward from the keyframe
+    std::atomic<uint32_t> loops{0};  // Phase 19: loop joins made by the decoder
+    uint64_t loop_gaps = 0;       // Phase 19: output frames further than one frame after the previous
+    uint64_t loop_dups = 0;       // Phase 19: output frames that didn't advance the timeline
+    size_t ring_depth = 0;        // Frames queued at the last update
+    size_t ring_capacity = 0;
+    double decode_ahead_sec = 0.0;  // Newest queued frame minus the frame on screen
+};
+
+// Phase 11: Master playback clock. Video frames are picked by presentation
+// time against this clock, so playback speed no longer follows the render rate.
+struct PlaybackClock {
+    bool playing = false;
+    double base_seconds = 0.0;  // Media time at base_time
+    std::chrono::steady_clock::time_point base_time = std::chrono::steady_clock::now();
+
+    double now() const {
+        if (!playing) return base_seconds;
+        return base_seconds + std::chrono::duration<double>(std::chrono::steady_clock::now() - base_time).count();
+    }
+
+    void play() {
+        if (playing) return;
+        base_time = std::chrono::steady_clock::now();
+        playing = true;
+    }
+
+    void pause() {
+        if (!playing) return;
+        base_seconds = now();
+        playing = false;
+    }
+
+    void seek(double seconds) {
+        base_seconds = seconds;
+        base_time = std::chrono::steady_clock::now();
+    }
+};
+
+// Phase 12: Packet scan behind FrameIndex::build(), with a private demuxer so
+// the decoder's read position is untouched. step() reads a bounded number of
+// packets, so the scan can also run a slice at a time on the decoder pool.
+struct FrameIndexScan {
+    AVFormatContext* ctx = nullptr;
+    AVPacket* packet = nullptr;
+    int stream_idx = -1;
+    std::vector<int64_t> pts, key_pts;  // Decode order
+
+    ~FrameIndexScan() { close(); }
+
+    bool open(const std::string& path, int stream) {
+        close();
+        stream_idx = stream;
+        if (avformat_open_input(&ctx, path.c_str(), nullptr, nullptr) < 0) return false;
+        if (avformat_find_stream_info(ctx, nullptr) < 0) {
+            close();
             return false;
         }
-        
-        // Find stream info
-        if (avformat_find_stream_info(fmt_ctx, nullptr) < 0) {
-            std::cerr << "Cannot find stream info\n";
+        packet = av_packet_alloc();
+        return packet != nullptr;
+    }
+
+    // False once the whole file has been read
+    bool step(int max_packets) {
+        for (int n = 0; n < max_packets; ++n) {
+            if (!ctx || av_read_frame(ctx, packet) < 0) return false;
+            if (packet->stream_index == stream_idx) {
+                int64_t ts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+                if (ts != AV_NOPTS_VALUE) {
+                    pts.push_back(ts);
+                    if (packet->flags & AV_PKT_FLAG_KEY) key_pts.push_back(ts);
+                }
+            }
+            av_packet_unref(packet);
+        }
+        return true;
+    }
+
+    void close() {
+        if (packet) av_packet_free(&packet);
+        if (ctx) avformat_close_input(&ctx);
+    }
+};
+
+// Phase 12: Per-file frame/keyframe index, persisted next to the media so
+// later opens skip the packet scan. Timestamps are in the stream time base.
+struct FrameIndex {
+    static constexpr char kMagic[8] = {'V', 'L', 'X', 'I', 'D', 'X', '1', '\0'};
+
+    std::vector<int64_t> frame_pts;  // Every frame's PTS in presentation order
+    std::vector<int> keyframes;      // Indices into frame_pts, ascending
+
+    bool empty() const { return frame_pts.empty(); }
+
+    // Frame index for a PTS: the first frame at or after it
+    int frame_for_pts(int64_t pts) const {
+        auto it = std::lower_bound(frame_pts.begin(), frame_pts.end(), pts);
+        if (it == frame_pts.end()) return (int)frame_pts.size() - 1;
+        return (int)(it - frame_pts.begin());
+    }
+
+    // Nearest keyframe at or before frame_idx
+    int keyframe_before(int frame_idx) const {
+        auto it = std::upper_bound(keyframes.begin(), keyframes.end(), frame_idx);
+        if (it == keyframes.begin()) return keyframes.empty() ? 0 : keyframes.front();
+        return *(it - 1);
+    }
+
+    // Scans the whole file in one go
+    bool build(const std::string& path, int stream_idx) {
+        frame_pts.clear();
+        keyframes.clear();
+        FrameIndexScan scan;
+        if (!scan.open(path, stream_idx)) return false;
+        while (scan.step(4096)) {}
+        return finish(scan);
+    }
+
+    // Takes a completed scan's packets
+    bool finish(FrameIndexScan& scan) {
+        // Packets arrive in decode order; frames are addressed in presentation order
+        frame_pts = std::move(scan.pts);
+        std::sort(frame_pts.begin(), frame_pts.end());
+        keyframes.clear();
+        for (int64_t ts : scan.key_pts) keyframes.push_back(frame_for_pts(ts));
+        std::sort(keyframes.begin(), keyframes.end());
+        keyframes.erase(std::unique(keyframes.begin(), keyframes.end()), keyframes.end());
+        return !frame_pts.empty();
+    }
+
+    // Sorted timestamps, and keyframes strictly ascending inside the frame range;
+    // seeks index frame_pts with keyframe entries unchecked
+    bool valid() const {
+        if (frame_pts.empty() || !std::is_sorted(frame_pts.begin(), frame_pts.end())) return false;
+        for (size_t i = 0; i < keyframes.size(); ++i) {
+            if (keyframes[i] < 0 || keyframes[i] >= (int)frame_pts.size()) return false;
+            if (i > 0 && keyframes[i] <= keyframes[i - 1]) return false;
+        }
+        return true;
+    }
+
+    bool save(const std::string& index_path, uint64_t media_size, int64_t media_mtime) const {
+        std::ofstream out(index_path, std::ios::binary);
+        if (!out) return false;
+        uint64_t frame_count = frame_pts.size(), key_count = keyframes.size();
+        out.write(kMagic, sizeof(kMagic));
+        out.write((const char*)&media_size, sizeof(media_size));
+        out.write((const char*)&media_mtime, sizeof(media_mtime));
+        out.write((const char*)&frame_count, sizeof(frame_count));
+        out.write((const char*)&key_count, sizeof(key_count));
+        out.write((const char*)frame_pts.data(), frame_count * sizeof(int64_t));
+        out.write((const char*)keyframes.data(), key_count * sizeof(int));
+        return (bool)out;
+    }
+
+    // Fails if the index is missing, corrupt, inconsistent (valid()), or was built
+    // for a different version of the file
+    bool load(const std::string& index_path, uint64_t media_size, int64_t media_mtime) {
+        std::ifstream in(index_path, std::ios::binary);
+        if (!in) return false;
+        char magic[sizeof(kMagic)] = {};
+        uint64_t size = 0, frame_count = 0, key_count = 0;
+        int64_t mtime = 0;
+        in.read(magic, sizeof(magic));
+        in.read((char*)&size, sizeof(size));
+        in.read((char*)&mtime, sizeof(mtime));
+        in.read((char*)&frame_count, sizeof(frame_count));
+        in.read((char*)&key_count, sizeof(key_count));
+        if (!in || memcmp(magic, kMagic, sizeof(kMagic)) != 0 || size != media_size || mtime != media_mtime) return false;
+        if (frame_count > (1u << 26) || key_count > frame_count) return false;
+
+        frame_pts.resize(frame_count);
+        keyframes.resize(key_count);
+        in.read((char*)frame_pts.data(), frame_count * sizeof(int64_t));
+        in.read((char*)keyframes.data(), key_count * sizeof(int));
+        if (!in || !valid()) {
+            frame_pts.clear();
+            keyframes.clear();
             return false;
         }
-        
-        // Find video stream
-        for (unsigned i = 0; i < fmt_ctx->nb_streams; i++) {
-            if (fmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-                video_stream_idx = i;
-                break;
+        return true;
+    }
+
+    // Size and modification time the sidecar is checked against
+    static bool media_stamp(const std::string& path, uint64_t& media_size, int64_t& media_mtime) {
+        std::error_code ec;
+        media_size = std::filesystem::file_size(path, ec);
+        if (ec) return false;
+        media_mtime = (int64_t)std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+        return !ec;
+    }
+
+    static std::string sidecar_path(const std::string& path) { return path + ".vlxidx"; }
+
+    bool load_sidecar(const std::string& path) {
+        uint64_t media_size = 0;
+        int64_t media_mtime = 0;
+        std::string index_path = sidecar_path(path);
+        if (!media_stamp(path, media_size, media_mtime) || !load(index_path, media_size, media_mtime)) return false;
+        std::cout << "Frame index loaded: " << index_path << " (" << frame_pts.size() << " frames, "
+                  << keyframes.size() << " keyframes)\n";
+        return true;
+    }
+
+    void save_sidecar(const std::string& path) const {
+        uint64_t media_size = 0;
+        int64_t media_mtime = 0;
+        std::string index_path = sidecar_path(path);
+        if (!media_stamp(path, media_size, media_mtime) || !save(index_path, media_size, media_mtime)) {
+            std::cerr << "Cannot write frame index: " << index_path << "\n";
+        }
+    }
+
+    // Loads the sidecar index or builds and persists a fresh one, on this thread
+    bool load_or_build(const std::string& path, int stream_idx) {
+        if (load_sidecar(path)) return true;
+
+        auto t0 = std::chrono::steady_clock::now();
+        if (!build(path, stream_idx)) {
+            std::cerr << "Cannot build frame index: " << path << "\n";
+            return false;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        std::cout << "Frame index built: " << frame_pts.size() << " frames, " << keyframes.size()
+                  << " keyframes in " << ms << " ms\n";
+        save_sidecar(path);
+        return true;
+    }
+};
+
+// Phase 18: Bounded LRU cache of converted frames for one clip, keyed by frame
+// index. Filled by the decoder as it goes; read by the render thread when
+// scrubbing so revisited frames need no seek or decode.
+class FrameCache {
+public:
+    void set_budget(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        budget_bytes = bytes;
+        evict_to_budget();
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        lru.clear();
+        entries.clear();
+        used_bytes = 0;
+    }
+
+    // Copies `f` into the cache with packed rows, recycling the evicted frame's storage
+    void insert(const DecodedFrame& f) {
+        size_t bytes = layout_frame_bytes(f.layout, f.width, f.height);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (bytes > budget_bytes) return;
+        auto found = entries.find(f.frame_index);
+        if (found != entries.end()) {
+            lru.splice(lru.begin(), lru, found->second.lru_pos);
+            return;
+        }
+
+        // Phase 22: once the budget is reached, the evicted entry's map node, list
+        // node and pixel storage are recycled, so a full cache doesn't allocate
+        decltype(entries)::node_type recycled;
+        while (used_bytes + bytes > budget_bytes && !lru.empty()) {
+            auto node = entries.extract(lru.back());
+            used_bytes -= node.mapped().frame.storage.size();
+            if (recycled.empty() && node.mapped().frame.storage.size() == bytes) {
+                lru.splice(lru.begin(), lru, std::prev(lru.end()));
+                recycled = std::move(node);
+            } else {
+                lru.pop_back();
+            }
+        }
+
+        Entry* e = nullptr;
+        if (!recycled.empty()) {
+            lru.front() = f.frame_index;
+            recycled.key() = f.frame_index;
+            e = &entries.insert(std::move(recycled)).position->second;
+        } else {
+            lru.push_front(f.frame_index);
+            e = &entries[f.frame_index];
+        }
+        e->lru_pos = lru.begin();
+        DecodedFrame& dst = e->frame;
+        dst.layout = f.layout;
+        dst.width = f.width;
+        dst.height = f.height;
+        dst.storage.resize(bytes);
+        dst.set_packed_planes(dst.storage.data());
+        dst.copy_from(f);
+        used_bytes += bytes;
+    }
+
+    // Copies the cached frame into `out` (storage reused once sized) so the
+    // caller can upload it without holding the cache lock
+    bool copy_frame(int frame_index, DecodedFrame& out) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = entries.find(frame_index);
+        if (found == entries.end()) {
+            misses++;
+            return false;
+        }
+        hits++;
+        lru.splice(lru.begin(), lru, found->second.lru_pos);
+        const DecodedFrame& f = found->second.frame;
+        out.layout = f.layout;
+        out.width = f.width;
+        out.height = f.height;
+        out.frame_index = f.frame_index;
+        out.pts_seconds = f.pts_seconds;
+        out.storage.resize(f.storage.size());
+        out.set_packed_planes(out.storage.data());
+        out.copy_from(f);
+        return true;
+    }
+
+    bool contains(int frame_index) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.count(frame_index) != 0;
+    }
+
+    size_t frame_count() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+
+    size_t bytes() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return used_bytes;
+    }
+
+    uint64_t hits = 0;    // Render thread only
+    uint64_t misses = 0;
+
+private:
+    struct Entry {
+        DecodedFrame frame;
+        std::list<int>::iterator lru_pos;
+    };
+
+    // Called with the mutex held
+    void evict_to_budget() {
+        while (used_bytes > budget_bytes && !lru.empty()) {
+            auto oldest = entries.find(lru.back());
+            used_bytes -= oldest->second.frame.storage.size();
+            entries.erase(oldest);
+            lru.pop_back();
+        }
+    }
+
+    std::mutex mutex;
+    std::list<int> lru;  // Most recently used first
+    std::unordered_map<int, Entry> entries;
+    size_t budget_bytes = 0;
+    size_t used_bytes = 0;
+};
+
+// Phase 16: Work driven by the shared decoder pool. step() does at most one
+// unit of work (typically one frame) and returns false if there was nothing to do.
+struct DecodeTask {
+    virtual ~DecodeTask() = default;
+    virtual bool step() = 0;
+};
+
+// Phase 16: Fixed set of worker threads shared by every playing source.
+// A task is only ever run by one thread at a time, so a decoder stays the
+// single producer of its frame ring no matter which thread steps it.
+class DecoderPool {
+public:
+    ~DecoderPool() { stop(); }
+
+    static int default_thread_count() {
+        int hw = (int)std::thread::hardware_concurrency();
+        return std::clamp(hw / 2, 2, 8);
+    }
+
+    void start(int count) {
+        if (!threads.empty()) return;
+        running = true;
+        for (int i = 0; i < count; ++i) threads.emplace_back(&DecoderPool::run, this);
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        changed.notify_all();
+        for (std::thread& t : threads) t.join();
+        threads.clear();
+    }
+
+    int thread_count() const { return (int)threads.size(); }
+
+    size_t task_count() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+
+    void add(DecodeTask* task) {
+        if (threads.empty()) start(default_thread_count());
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            entries.push_back({task, false});
+        }
+        changed.notify_all();
+    }
+
+    // Blocks until no worker is inside task->step(); at most one frame of work
+    void remove(DecodeTask* task) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] {
+            for (const Entry& e : entries) {
+                if (e.task == task) return !e.busy;
+            }
+            return true;
+        });
+        entries.erase(std::remove_if(entries.begin(), entries.end(), [&](const Entry& e) { return e.task == task; }),
+                      entries.end());
+    }
+
+private:
+    struct Entry {
+        DecodeTask* task;
+        bool busy;
+    };
+
+    void run() {
+        set_alloc_role(AllocRole::Decode);
+        std::unique_lock<std::mutex> lock(mutex);
+        size_t idle_steps = 0;
+        while (running) {
+            // Round-robin over tasks no other worker is stepping
+            DecodeTask* task = nullptr;
+            for (size_t n = 0; n < entries.size() && !task; ++n) {
+                Entry& e = entries[(cursor + n) % entries.size()];
+                if (!e.busy) {
+                    e.busy = true;
+                    task = e.task;
+                    cursor = (cursor + n + 1) % entries.size();
+                }
+            }
+            if (!task || idle_steps > entries.size()) {
+                // Nothing runnable, or a full round found no work: back off briefly
+                idle_steps = 0;
+                if (task) release(task);
+                changed.wait_for(lock, std::chrono::milliseconds(1));
+                continue;
+            }
+
+            lock.unlock();
+            bool worked = task->step();
+            lock.lock();
+            release(task);
+            idle_steps = worked ? 0 : idle_steps + 1;
+        }
+    }
+
+    // Called with the mutex held
+    void release(DecodeTask* task) {
+        for (Entry& e : entries) {
+            if (e.task == task) e.busy = false;
+        }
+        changed.notify_all();
+    }
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<Entry> entries;
+    size_t cursor = 0;
+    bool running = false;
+};
+
+// Phase 12: Builds a clip's missing index on the decoder pool, a slice of
+// packets per step, so opening an unindexed file never stalls the render
+// thread. `target` is only written before `ready` is published; the decoder
+// seeks by time until then.
+class FrameIndexBuild : public DecodeTask {
+public:
+    static constexpr int kPacketsPerStep = 512;
+
+    FrameIndexBuild(const std::string& media_path, FrameIndex& index, std::atomic<bool>& index_ready,
+                    std::atomic<int>& frame_count)
+        : path(media_path), target(&index), ready(&index_ready), total_frames(&frame_count) {}
+
+    bool start(int stream_idx) {
+        t0 = std::chrono::steady_clock::now();
+        return scan.open(path, stream_idx);
+    }
+
+    bool step() override {
+        if (done) return false;
+        if (scan.step(kPacketsPerStep)) return true;
+
+        scan.close();
+        done = true;
+        if (!target->finish(scan)) {
+            std::cerr << "Cannot build frame index: " << path << "\n";
+            return true;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        std::cout << "Frame index built: " << target->frame_pts.size() << " frames, " << target->keyframes.size()
+                  << " keyframes in " << ms << " ms (background)\n";
+        target->save_sidecar(path);
+        total_frames->store((int)target->frame_pts.size(), std::memory_order_relaxed);
+        ready->store(true, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::string path;
+    FrameIndex* target;
+    std::atomic<bool>* ready;
+    std::atomic<int>* total_frames;
+    FrameIndexScan scan;
+    std::chrono::steady_clock::time_point t0;
+    bool done = false;
+};
+
+// Phase 23: Numbered stills played as a clip, e.g. shots/frame_%05d.png@24 where
+// the part after '@' is the frame rate. Frames don't depend on each other, so
+// several pool tasks load ahead in parallel into a bounded reorder buffer and
+// the owning decoder takes them out in frame order.
+class ImageSequence {
+public:
+    static constexpr double kDefaultFps = 30.0;
+
+    std::string pattern;          // Path as given, without the @fps suffix
+    std::string path_prefix;      // Everything before the number token
+    std::string path_suffix;      // Everything after it
+    int number_width = 0;         // Zero-padded digits, 0 = unpadded
+    int first_number = 0;         // Number in the name of the first file
+    int frame_count = 0;
+    int width = 0, height = 0;    // Size of the first file; every frame is RGBA at this size
+    double fps = kDefaultFps;
+
+    std::atomic<float> last_load_ms{0.0f};
+
+    ~ImageSequence() { stop(); }
+
+    // Locates the number token in a file name: exactly one '%' in it, as %d or
+    // %0Nd with N = 1-9. `width` is N, or 0 for %d.
+    static bool find_number_token(const std::string& name, size_t& pos, size_t& len, int& width) {
+        pos = name.find('%');
+        if (pos == std::string::npos || name.find('%', pos + 1) != std::string::npos) return false;
+        size_t d = pos + 1;
+        bool padded = d < name.size() && name[d] == '0';
+        if (padded) ++d;
+        size_t digits = d;
+        while (d < name.size() && name[d] >= '0' && name[d] <= '9') ++d;
+        if (d >= name.size() || name[d] != 'd' || d - digits != (padded ? 1u : 0u) || (padded && name[digits] == '0')) {
+            return false;
+        }
+        width = padded ? name[digits] - '0' : 0;
+        len = d + 1 - pos;
+        return true;
+    }
+
+    static bool is_pattern(const std::string& path) {
+        size_t pos, len;
+        int width;
+        return find_number_token(std::filesystem::path(path).filename().string(), pos, len, width);
+    }
+
+    // Finds the numbered files and sizes `prefetch` reorder slots for them
+    bool open(const std::string& path, int prefetch) {
+        stop();
+        fps = kDefaultFps;
+        std::string name = std::filesystem::path(path).filename().string();
+        size_t start = 0, len = 0;
+        if (!find_number_token(name, start, len, number_width)) {
+            std::cerr << "Image sequence needs one %d or %0Nd in the file name: " << path << "\n";
+            return false;
+        }
+        size_t name_pos = path.size() - name.size();
+        pattern = path;
+        size_t at = name.rfind('@');
+        if (at != std::string::npos && at > start) {
+            pattern = path.substr(0, name_pos + at);
+            fps = std::atof(name.c_str() + at + 1);
+            if (fps <= 0.0) fps = kDefaultFps;
+            name.resize(at);
+        }
+
+        // Files are named prefix + number + suffix; playback runs from the lowest
+        // number up to the first gap. Only the number is ever formatted, so a '%'
+        // elsewhere in the path is never read as a conversion.
+        std::string prefix = name.substr(0, start);
+        std::string suffix = name.substr(start + len);
+        path_prefix = pattern.substr(0, name_pos + start);
+        path_suffix = suffix;
+        std::filesystem::path pattern_path(pattern);
+        std::filesystem::path dir = pattern_path.has_parent_path() ? pattern_path.parent_path() : ".";
+
+        std::vector<int> numbers;
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+            std::string file = entry.path().filename().string();
+            if (file.size() <= prefix.size() + suffix.size() || file.compare(0, prefix.size(), prefix) != 0 ||
+                file.compare(file.size() - suffix.size(), suffix.size(), suffix) != 0) {
+                continue;
+            }
+            std::string digits = file.substr(prefix.size(), file.size() - prefix.size() - suffix.size());
+            if (digits.size() > 9 || (int)digits.size() < number_width ||
+                !std::all_of(digits.begin(), digits.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+                continue;
             }
+            numbers.push_back(std::atoi(digits.c_str()));
+        }
+        if (numbers.empty()) {
+            std::cerr << "No files match image sequence: " << pattern << "\n";
+            return false;
+        }
+        std::sort(numbers.begin(), numbers.end());
+        first_number = numbers[0];
+        frame_count = 1;
+        while (frame_count < (int)numbers.size() && numbers[frame_count] == first_number + frame_count) ++frame_count;
+        if (frame_count < (int)numbers.size()) {
+            std::cerr << "Image sequence has a gap after frame " << first_number + frame_count - 1 << "; playing the first "
+                      << frame_count << " frames\n";
+        }
+
+        char file[1024];
+        file_name(0, file, sizeof(file));
+        int c;
+        if (!stbi_info(file, &width, &height, &c)) {
+            std::cerr << "Cannot read image: " << file << "\n";
+            return false;
+        }
+
+        slots.assign(std::max(2, prefetch), Slot());
+        for (Slot& slot : slots) slot.pixels.resize((size_t)width * height * 4);
+        next_load = next_take = 0;
+        held = nullptr;
+        return true;
+    }
+
+    // Adds `threads` loader tasks to the pool; each loads one frame per step
+    void start(DecoderPool& decode_pool, int threads) {
+        if (pool) return;
+        pool = &decode_pool;
+        for (int i = 0; i < std::max(1, threads); ++i) {
+            loaders.push_back(std::make_unique<Loader>());
+            loaders.back()->sequence = this;
+            pool->add(loaders.back().get());
+        }
+    }
+
+    // Returns once no loader is running; slots being loaded stay claimed until then
+    void stop() {
+        if (!pool) return;
+        for (auto& loader : loaders) pool->remove(loader.get());
+        loaders.clear();
+        pool = nullptr;
+    }
+
+    int loader_count() const { return (int)loaders.size(); }
+    size_t buffer_bytes() const { return slots.size() * (size_t)width * height * 4; }
+
+    // Frames loaded and waiting to be taken
+    int ready_count() {
+        std::lock_guard<std::mutex> lock(mutex);
+        int ready = 0;
+        for (const Slot& slot : slots) ready += slot.state == kReady;
+        return ready;
+    }
+
+    // Decoder side. Drops everything loaded ahead and continues from `frame`
+    void seek(int frame) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++generation;
+        for (Slot& slot : slots) {
+            if (slot.state != kLoading) slot.state = kEmpty;  // Loading slots are dropped when they finish
+        }
+        held = nullptr;
+        next_load = next_take = std::clamp(frame, 0, std::max(0, frame_count - 1));
+    }
+
+    // Decoder side. True while another task is still loading the next frame
+    bool next_loading() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return next_take < frame_count && !slots.empty() && slots[next_take % slots.size()].state == kLoading;
+    }
+
+    // Decoder side. Pixels of the next frame, valid until the next take() or
+    // seek(); nullptr past the last frame. Loads the frame right here when no
+    // loader has claimed it yet (synchronous playback, or just after a seek).
+    uint8_t* take(int& frame) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (held) held->state = kEmpty;
+        held = nullptr;
+        if (next_take >= frame_count || slots.empty()) return nullptr;
+
+        Slot& slot = slots[next_take % slots.size()];
+        loaded.wait(lock, [&] { return slot.state != kLoading; });
+        if (slot.state != kReady) {
+            // Nothing claimed at or past this frame, so the loaders continue after it
+            next_load = next_take + 1;
+            slot.state = kLoading;
+            slot.frame = next_take;
+            slot.generation = generation;
+            lock.unlock();
+            load(slot);
+            lock.lock();
+        }
+        slot.state = kTaken;
+        held = &slot;
+        frame = next_take++;
+        loaded.notify_all();  // The window moved on; loaders may have room again
+        return slot.pixels.data();
+    }
+
+private:
+    enum SlotState { kEmpty, kLoading, kReady, kTaken };
+
+    struct Slot {
+        std::vector<uint8_t> pixels;
+        int frame = -1;
+        int generation = 0;
+        SlotState state = kEmpty;
+    };
+
+    struct Loader : DecodeTask {
+        ImageSequence* sequence = nullptr;
+        bool step() override { return sequence->load_ahead(); }
+    };
+
+    void file_name(int frame, char* out, size_t size) const {
+        snprintf(out, size, "%s%0*d%s", path_prefix.c_str(), number_width, first_number + frame, path_suffix.c_str());
+    }
+
+    // Loader side: claims the next frame inside the prefetch window, if its slot is free
+    bool load_ahead() {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (next_load >= frame_count || next_load >= next_take + (int)slots.size()) return false;
+        Slot& slot = slots[next_load % slots.size()];
+        if (slot.state != kEmpty) return false;
+        slot.state = kLoading;
+        slot.frame = next_load++;
+        slot.generation = generation;
+        lock.unlock();
+
+        load(slot);
+
+        lock.lock();
+        slot.state = slot.generation == generation ? kReady : kEmpty;  // A seek happened meanwhile
+        loaded.notify_all();
+        return true;
+    }
+
+    // Runs without the lock; the slot is owned by whoever set it to kLoading.
+    // A missing or mismatched file shows as black rather than stalling playback.
+    void load(Slot& slot) {
+        auto t0 = std::chrono::steady_clock::now();
+        char file[1024];
+        file_name(slot.frame, file, sizeof(file));
+        int w, h, c;
+        unsigned char* data = stbi_load(file, &w, &h, &c, 4);
+        if (data && w == width && h == height) {
+            memcpy(slot.pixels.data(), data, slot.pixels.size());
+        } else {
+            std::cerr << (data ? "Image size differs from the sequence: " : "Failed to load image: ") << file << "\n";
+            memset(slot.pixels.data(), 0, slot.pixels.size());
+        }
+        stbi_image_free(data);
+        last_load_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    }
+
+    std::vector<Slot> slots;      // Frame f lives in slots[f % size] while it is in the window
+    std::mutex mutex;
+    std::condition_variable loaded;
+    int next_load = 0;            // Next frame a loader may claim
+    int next_take = 0;            // Next frame the decoder takes
+    int generation = 0;           // Bumped by seek()
+    Slot* held = nullptr;         // Slot handed out by the last take()
+    DecoderPool* pool = nullptr;
+    std::vector<std::unique_ptr<Loader>> loaders;
+};
+
+// Phase 5: Video decoder using FFmpeg
+class VideoDecoder : public DecodeTask {
+public:
+    AVFormatContext* fmt_ctx = nullptr;
+    AVCodecContext* codec_ctx = nullptr;
+    SwsContext* sws_ctx = nullptr;
+    AVFrame* frame = nullptr;
+    AVPacket* packet = nullptr;          // Phase 22: reused by every decode call
+    DecodedFrame converted;              // Conversion target for the synchronous path
+    int video_stream_idx = -1;
+    int width = 0, height = 0;           // Output size of converted frames
+    int src_width = 0, src_height = 0;   // Phase 20: coded size of the stream
+    int output_shift = 0;                // Phase 20: output is the source size >> output_shift
+    int max_lowres = 0;                  // Phase 20: largest lowres factor the codec can decode at
+    std::atomic<int> total_frames{0};    // Phase 12: exact once the index is ready
+    std::atomic<int64_t> current_frame{0};  // Written by the decode thread, read by the render/UI thread
+    double frame_duration = 1.0 / 30.0;  // Seconds per frame from the stream's average rate
+    FrameIndex index;                    // Phase 12: keyframe/PTS index for exact seeks; read only if has_index()
+    std::atomic<bool> index_ready{false};
+    std::unique_ptr<FrameIndexBuild> index_build;  // Phase 12: background scan when there was no sidecar
+    DecoderPool* index_pool = nullptr;
+    bool allow_yuv = true;               // Phase 13: upload native planes instead of converting to RGBA
+    FrameLayout output_layout = FrameLayout::RGBA;
+    int color_matrix = 0;                // Phase 13: 0 = BT.601, 1 = BT.709
+    bool full_range = false;             // Phase 13: JPEG (0-255) rather than MPEG (16-235) levels
+    bool has_pending_frame = false;      // Phase 12: `frame` already holds the next frame to return
+
+    int ffmpeg_threads = 0;              // Phase 16: codec thread count chosen at open
+    std::unique_ptr<ImageSequence> sequence;  // Phase 23: set when playing numbered stills
+    int sequence_prefetch = 16;          // Phase 23: stills loaded ahead of the ring
+    FrameCache cache;                    // Phase 18: recently decoded frames for scrubbing
+    bool cache_enabled = false;          // Phase 18: opt-in; only the source the user scrubs keeps a cache
+    bool cache_decoded = false;          // Phase 18: cache_enabled, and slots aren't in mapped GL memory
+
+    // Phase 19: gapless looping. Output PTS keep increasing across the join, so
+    // the master clock never jumps back; only the source position does.
+    static constexpr int kPrerollFrames = 8;
+    std::atomic<bool> loop_enabled{false};
+    std::atomic<int> loop_in{0};
+    std::atomic<int> loop_out{-1};       // Last frame of the loop, -1 = end of clip
+    double loop_offset_seconds = 0.0;    // Added to source PTS after each join
+    double last_raw_seconds = 0.0;       // Source PTS of the last frame handed out
+    std::vector<DecodedFrame> preroll;   // Converted frames from the in-point (decode thread only)
+    int preroll_in = -1;                 // In-point the preroll belongs to
+    int preroll_count = 0;               // Contiguous frames captured from preroll_in
+    int preroll_pos = -1;                // Next preroll frame to push after a join, -1 = none
+    bool loop_seek_pending = false;      // Seek past the preroll not yet done
+    int last_output_serial = -1;         // Render side continuity check
+    double last_output_seconds = -1.0;
+
+    // Phase 21: a suspended decoder produces no ring frames. It keeps the demuxer
+    // open and one converted "warm" frame following the show time.
+    std::atomic<bool> suspended{false};
+    std::atomic<double> warm_request{-1.0};  // Timeline seconds to bring the warm frame to
+    std::atomic<bool> resume_request{false}; // The pending seek leaves suspension
+    std::mutex warm_mutex;
+    DecodedFrame warm;                   // Guarded by warm_mutex
+    int warm_index = -1;                 // Frame held in `warm`, -1 = none (guarded)
+    int warm_target = -1;                // Frame step_warm() decodes towards (decode thread only)
+    int parked_frame = -1;               // Last frame decoded while suspended; the demuxer sits right after it
+
+    // Phase 10: threaded decode state
+    SpscRing<DecodedFrame> ring;
+    DecodeStats stats;
+    DecoderPool* pool = nullptr;         // Phase 16: pool stepping this decoder while async
+    std::atomic<bool> worker_running{false};
+    std::atomic<bool> worker_eof{false};
+    std::atomic<int> seek_request{-1};
+    std::atomic<double> seek_offset_request{0.0};  // Phase 19: loop offset the seek resumes with
+    std::atomic<int> serial{0};
+    std::atomic<double> clock_seconds{0.0};  // Phase 11: master clock as last seen by the render loop
+    double max_decode_ahead = 0.25;          // Phase 11: seconds the worker may run ahead of the clock
+    double last_pushed_seconds = -1.0;
+    bool input_eof = false;
+    std::atomic<int64_t> next_frame_index{0};
+    
+    ~VideoDecoder() { cleanup(); }
+    
+    void cleanup() {
+        stop_async();
+        sequence.reset();
+        ring.reset(0);
+        converted.storage.clear();
+        if (frame) av_frame_free(&frame);
+        if (packet) av_packet_free(&packet);
+        if (sws_ctx) sws_freeContext(sws_ctx);
+        sws_ctx = nullptr;
+        if (codec_ctx) avcodec_free_context(&codec_ctx);
+        if (fmt_ctx) avformat_close_input(&fmt_ctx);
+        video_stream_idx = -1;
+        current_frame.store(0, std::memory_order_release);
+        next_frame_index.store(0, std::memory_order_relaxed);
+        input_eof = false;
+        has_pending_frame = false;
+        if (index_build) index_pool->remove(index_build.get());  // Waits out a step in progress
+        index_build.reset();
+        index_ready = false;
+        index = FrameIndex();
+    }
+
+    // Phase 12: index loaded or finished building; until then seeks are by time
+    bool has_index() const { return index_ready.load(std::memory_order_acquire); }
+    
+    // Phase 16: thread_count > 0 sets FFmpeg's own frame/slice threading.
+    // Phase 12: with a pool, a missing index is built there instead of here.
+    bool open(const std::string& path, int thread_count = 0, DecoderPool* build_pool = nullptr) {
+        cleanup();
+        cache.clear();
+        if (ImageSequence::is_pattern(path)) return open_sequence(path, thread_count);
+        
+        // Open file
+        if (avformat_open_input(&fmt_ctx, path.c_str(), nullptr, nullptr) < 0) {
+            std::cerr << "Cannot open file: " << path << "\n";
+            return false;
+        }
+        
+        // Find stream info
+        if (avformat_find_stream_info(fmt_ctx, nullptr) < 0) {
+            std::cerr << "Cannot find stream info\n";
+            return false;
+        }
+        
+        // Find video stream
+        for (unsigned i = 0; i < fmt_ctx->nb_streams; i++) {
+            if (fmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+                video_stream_idx = i;
+                break;
+            }
+        }
+        
+        if (video_stream_idx < 0) {
+            std::cerr << "No video stream found\n";
+            return false;
+        }
+        
+        // Get codec and open
+        ffmpeg_threads = thread_count;
+        if (!open_codec(0)) return false;
+        
+        src_width = codec_ctx->width;
+        src_height = codec_ctx->height;
+        output_shift = 0;
+        width = src_width;
+        height = src_height;
+        
+        // Allocate frames
+        frame = av_frame_alloc();
+        packet = av_packet_alloc();
+        if (!frame || !packet) {
+            std::cerr << "Cannot allocate frames\n";
+            return false;
+        }
+        
+        // Phase 13: pick the upload layout and colour metadata for the shader
+        choose_output_layout();
+        AVColorSpace colorspace = codec_ctx->colorspace;
+        if (colorspace == AVCOL_SPC_BT709) {
+            color_matrix = 1;
+        } else if (colorspace == AVCOL_SPC_BT470BG || colorspace == AVCOL_SPC_SMPTE170M) {
+            color_matrix = 0;
+        } else {
+            color_matrix = src_height >= 720 ? 1 : 0;  // Untagged: assume HD content is BT.709
+        }
+        full_range = codec_ctx->color_range == AVCOL_RANGE_JPEG || codec_ctx->pix_fmt == AV_PIX_FMT_YUVJ420P;
+
+        // Calculate total frames
+        AVStream* stream = fmt_ctx->streams[video_stream_idx];
+        if (stream->nb_frames > 0) {
+            total_frames = stream->nb_frames;
+        } else if (stream->duration > 0 && stream->avg_frame_rate.num > 0 && stream->avg_frame_rate.den > 0) {
+            total_frames = (int)av_rescale_q(stream->duration, stream->time_base, av_inv_q(stream->avg_frame_rate));
+        }
+        if (stream->avg_frame_rate.num > 0 && stream->avg_frame_rate.den > 0) {
+            frame_duration = 1.0 / av_q2d(stream->avg_frame_rate);
+        }
+
+        // Phase 12: exact frame count and seek targets come from the index when we have one
+        if (index.load_sidecar(path) || (!build_pool && index.load_or_build(path, video_stream_idx))) {
+            total_frames = (int)index.frame_pts.size();
+            index_ready = true;
+        } else if (build_pool) {
+            index_build = std::make_unique<FrameIndexBuild>(path, index, index_ready, total_frames);
+            if (index_build->start(video_stream_idx)) {
+                index_pool = build_pool;
+                index_pool->add(index_build.get());
+            } else {
+                std::cerr << "Cannot build frame index: " << path << "\n";
+                index_build.reset();
+            }
+        }
+        
+        std::cout << "Video opened: " << path << " (" << width << "x" << height << ", " << total_frames << (index_build ? " frames (estimated, indexing), " : " frames, ")
+                  << (output_layout == FrameLayout::RGBA ? "RGBA" : output_layout == FrameLayout::NV12 ? "NV12" : "YUV420P")
+                  << " upload)\n";
+        return true;
+    }
+
+    // Phase 23: Stills are loaded as RGBA by the sequence's own tasks; `frame`
+    // only carries each one through the same conversion and ring as video.
+    // For sequences, thread_count is the number of frames loaded in parallel.
+    bool open_sequence(const std::string& path, int thread_count) {
+        sequence = std::make_unique<ImageSequence>();
+        if (!sequence->open(path, sequence_prefetch)) {
+            sequence.reset();
+            return false;
+        }
+        ffmpeg_threads = thread_count;
+        max_lowres = 0;
+        src_width = width = sequence->width;
+        src_height = height = sequence->height;
+        output_shift = 0;
+        total_frames = sequence->frame_count;
+        frame_duration = 1.0 / sequence->fps;
+        output_layout = FrameLayout::RGBA;
+        color_matrix = 0;
+        full_range = true;
+
+        frame = av_frame_alloc();
+        if (!frame) {
+            std::cerr << "Cannot allocate frames\n";
+            return false;
+        }
+        std::cout << "Image sequence opened: " << sequence->pattern << " (" << width << "x" << height << ", "
+                  << total_frames << " frames at " << sequence->fps << " fps)\n";
+        return true;
+    }
+
+    // (Re)creates the codec context; lowres > 0 has the codec decode at 1/2^lowres size
+    bool open_codec(int lowres) {
+        if (codec_ctx) avcodec_free_context(&codec_ctx);
+        const AVCodec* codec = avcodec_find_decoder(fmt_ctx->streams[video_stream_idx]->codecpar->codec_id);
+        if (!codec) {
+            std::cerr << "Codec not found\n";
+            return false;
+        }
+        max_lowres = codec->max_lowres;
+        
+        codec_ctx = avcodec_alloc_context3(codec);
+        avcodec_parameters_to_context(codec_ctx, fmt_ctx->streams[video_stream_idx]->codecpar);
+        if (ffmpeg_threads > 0) {
+            codec_ctx->thread_count = ffmpeg_threads;
+            codec_ctx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+        }
+        codec_ctx->lowres = std::min(lowres, max_lowres);
+        
+        if (avcodec_open2(codec_ctx, codec, nullptr) < 0) {
+            std::cerr << "Cannot open codec\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Phase 20: Output at the source size >> shift. Codecs with lowres support
+    // decode at the reduced size directly; otherwise the conversion stage scales.
+    // Not thread-safe: call with the decode thread stopped, then seek.
+    bool set_output_scale(int shift) {
+        if (!codec_ctx && !sequence) return false;
+        int lowres = std::min(shift, max_lowres);
+        if (codec_ctx && lowres != codec_ctx->lowres && !open_codec(lowres)) return false;
+        output_shift = shift;
+        width = std::max(1, (src_width + (1 << shift) - 1) >> shift);
+        height = std::max(1, (src_height + (1 << shift) - 1) >> shift);
+        return true;
+    }
+
+    // Phase 13: Native planes for formats the shader understands, RGBA otherwise
+    void choose_output_layout() {
+        output_layout = FrameLayout::RGBA;
+        if (!allow_yuv || !codec_ctx) return;
+        if (codec_ctx->pix_fmt == AV_PIX_FMT_YUV420P || codec_ctx->pix_fmt == AV_PIX_FMT_YUVJ420P) {
+            output_layout = FrameLayout::YUV420P;
+        } else if (codec_ctx->pix_fmt == AV_PIX_FMT_NV12) {
+            output_layout = FrameLayout::NV12;
+        }
+    }
+
+    // Phase 23: True when `frame` can't be used as-is for an output in `layout`
+    bool needs_conversion(FrameLayout layout) const {
+        return (layout == FrameLayout::RGBA && frame->format != AV_PIX_FMT_RGBA) ||
+               frame->width != width || frame->height != height;
+    }
+
+    // Phase 13: Write the current `frame` into dst's planes, converting only for RGBA
+    // Phase 20: or when the output is smaller than what the codec produced
+    void convert_frame(DecodedFrame& dst) {
+        if (needs_conversion(dst.layout)) {
+            AVPixelFormat dst_format = dst.layout == FrameLayout::RGBA ? AV_PIX_FMT_RGBA
+                                     : dst.layout == FrameLayout::NV12 ? AV_PIX_FMT_NV12 : AV_PIX_FMT_YUV420P;
+            sws_ctx = sws_getCachedContext(sws_ctx, frame->width, frame->height, (AVPixelFormat)frame->format,
+                                           width, height, dst_format, SWS_BILINEAR, nullptr, nullptr, nullptr);
+            if (!sws_ctx) return;
+            uint8_t* dst_data[4] = {dst.planes[0], dst.planes[1], dst.planes[2], nullptr};
+            int dst_linesize[4] = {dst.strides[0], dst.strides[1], dst.strides[2], 0};
+            sws_scale(sws_ctx, frame->data, frame->linesize, 0, frame->height, dst_data, dst_linesize);
+            return;
+        }
+        for (int p = 0; p < layout_plane_count(dst.layout); ++p) {
+            int w, h, bpp;
+            layout_plane_size(dst.layout, p, width, height, w, h, bpp);
+            av_image_copy_plane(dst.planes[p], dst.strides[p], frame->data[p], frame->linesize[p], w * bpp, h);
+        }
+    }
+
+    // Pulls the next decoded picture into `frame`, draining the codec at end of file
+    bool decode_next_frame() {
+        if (has_pending_frame) {
+            // Phase 12: left over from an exact seek
+            has_pending_frame = false;
+            return true;
+        }
+
+        if (sequence) {
+            // Phase 23: the next still, in frame order
+            int frame_idx = 0;
+            uint8_t* pixels = sequence->take(frame_idx);
+            if (!pixels) return false;
+            frame->data[0] = pixels;
+            frame->linesize[0] = sequence->width * 4;
+            frame->width = sequence->width;
+            frame->height = sequence->height;
+            frame->format = AV_PIX_FMT_RGBA;
+            frame->pts = frame->best_effort_timestamp = frame_idx;
+            return true;
+        }
+
+        // Phase 22: one packet per decoder, allocated at open
+        if (!packet) return false;
+
+        bool got_frame = false;
+        while (true) {
+            int ret = avcodec_receive_frame(codec_ctx, frame);
+            if (ret == 0) {
+                got_frame = true;
+                break;
+            }
+            if (ret == AVERROR_EOF || input_eof) break;
+
+            // Decoder needs more input
+            if (av_read_frame(fmt_ctx, packet) < 0) {
+                avcodec_send_packet(codec_ctx, nullptr);  // Flush delayed frames
+                input_eof = true;
+                continue;
+            }
+            if (packet->stream_index == video_stream_idx) {
+                avcodec_send_packet(codec_ctx, packet);
+            }
+            av_packet_unref(packet);
+        }
+
+        return got_frame;
+    }
+
+    static int64_t frame_timestamp(const AVFrame* f) {
+        return f->best_effort_timestamp != AV_NOPTS_VALUE ? f->best_effort_timestamp : f->pts;
+    }
+
+    double frame_seconds(const AVFrame* f) const {
+        if (sequence) return frame_timestamp(f) * frame_duration;  // Phase 23: timestamps are frame numbers
+        AVStream* stream = fmt_ctx->streams[video_stream_idx];
+        int64_t ts = frame_timestamp(f);
+        if (ts == AV_NOPTS_VALUE) return 0.0;
+        if (stream->start_time != AV_NOPTS_VALUE) ts -= stream->start_time;
+        return ts * av_q2d(stream->time_base);
+    }
+
+    // Phase 16: Frame number shown at a given clock time
+    int frame_at_seconds(double seconds) const {
+        if (!has_index() || !fmt_ctx) return std::max(0, (int)(seconds / frame_duration + 0.5));
+        AVStream* stream = fmt_ctx->streams[video_stream_idx];
+        int64_t ts = (int64_t)std::llround(seconds / av_q2d(stream->time_base));
+        if (stream->start_time != AV_NOPTS_VALUE) ts += stream->start_time;
+        int idx = index.frame_for_pts(ts);
+        // frame_for_pts rounds up; the frame on screen is the last one at or before `seconds`
+        if (idx > 0 && index.frame_pts[idx] > ts) --idx;
+        return idx;
+    }
+
+    // Phase 12: Presentation time of a frame number, exact when indexed
+    double frame_index_seconds(int frame_idx) const {
+        if (!has_index() || !fmt_ctx) return frame_idx * frame_duration;
+        AVStream* stream = fmt_ctx->streams[video_stream_idx];
+        int64_t ts = index.frame_pts[std::clamp(frame_idx, 0, (int)index.frame_pts.size() - 1)];
+        if (stream->start_time != AV_NOPTS_VALUE) ts -= stream->start_time;
+        return ts * av_q2d(stream->time_base);
+    }
+
+    // Phase 12: Number the decoded frame from the index when possible
+    int frame_number(const AVFrame* f) {
+        int64_t ts = frame_timestamp(f);
+        int idx = has_index() && ts != AV_NOPTS_VALUE ? index.frame_for_pts(ts)
+                                                          : (int)next_frame_index.load(std::memory_order_relaxed);
+        next_frame_index.store(idx + 1, std::memory_order_relaxed);
+        return idx;
+    }
+    
+    // Phase 11: Decodes up to `clock`, converting only the frame that will be shown.
+    // Full-size YUV frames are returned pointing straight at FFmpeg's planes (valid
+    // until the next decode call); RGBA or scaled frames at the conversion buffer.
+    bool get_frame(double clock, DecodedFrame& out) {
+        if (!frame) return false;
+
+        bool got_frame = false;
+        bool looped = false;
+        while (true) {
+            bool decoded = decode_next_frame();
+            int frame_idx = decoded ? frame_number(frame) : -1;
+            if (loop_enabled && !looped && (!decoded || frame_idx > loop_end_frame())) {
+                // Phase 19: without the decode thread there is no preroll; loop by seeking
+                join_loop();
+                looped = true;
+                continue;
+            }
+            if (!decoded) break;
+            got_frame = true;
+            current_frame.store(frame_idx, std::memory_order_release);
+            last_raw_seconds = frame_seconds(frame);
+            out.pts_seconds = last_raw_seconds + loop_offset_seconds;
+            if (out.pts_seconds + frame_duration > clock) break;
+            stats.frames_dropped++;
+        }
+        if (!got_frame) return false;
+
+        out.layout = output_layout;
+        out.width = width;
+        out.height = height;
+        out.frame_index = (int)current_frame.load(std::memory_order_relaxed);
+        for (int p = 0; p < 3; ++p) {
+            out.planes[p] = nullptr;
+            out.strides[p] = 0;
+        }
+        if (needs_conversion(output_layout)) {
+            if (converted.layout != output_layout || converted.width != width || converted.height != height ||
+                converted.storage.empty()) {
+                converted.layout = output_layout;
+                converted.width = width;
+                converted.height = height;
+                converted.storage.resize(layout_frame_bytes(output_layout, width, height));
+                converted.set_packed_planes(converted.storage.data());
+            }
+            convert_frame(converted);
+            for (int p = 0; p < 3; ++p) {
+                out.planes[p] = converted.planes[p];
+                out.strides[p] = converted.strides[p];
+            }
+        } else {
+            for (int p = 0; p < layout_plane_count(output_layout); ++p) {
+                out.planes[p] = frame->data[p];
+                out.strides[p] = frame->linesize[p];
+            }
+        }
+        return true;
+    }
+    
+    // Phase 19: `loop_offset` is added to the PTS of every frame after the seek,
+    // so a seek into a later loop iteration stays on the timeline
+    void seek_to_frame(int frame_idx, double loop_offset = 0.0) {
+        if ((!fmt_ctx || video_stream_idx < 0) && !sequence) return;
+
+        if (worker_running) {
+            // The decode thread owns the FFmpeg contexts; hand the request over.
+            // Publish the target before bumping the generation so any frame tagged
+            // with the new serial is guaranteed to come from after the seek.
+            seek_offset_request.store(loop_offset);
+            seek_request.store(frame_idx);
+            serial.fetch_add(1);
+            current_frame.store(frame_idx, std::memory_order_release);
+            return;
+        }
+        seek_internal(frame_idx);
+        reset_loop_state();
+        loop_offset_seconds = loop_offset;
+    }
+
+    // Phase 21: Leaves suspension at `frame_idx` through the seek handoff. The
+    // worker decodes forward from the frame it is parked on when that is cheaper.
+    void resume_at_frame(int frame_idx, double loop_offset) {
+        warm_request.store(-1.0);
+        resume_request.store(true);
+        seek_to_frame(frame_idx, loop_offset);
+        suspended = false;
+    }
+
+    // Phase 21: Decodes forward from the parked frame to `frame_idx` when both lie
+    // in the same GOP, leaving it pending as an exact seek would. False if a
+    // seek is needed instead.
+    bool catch_up_to(int frame_idx) {
+        if (!has_index() || parked_frame < 0 || frame_idx < parked_frame ||
+            index.keyframe_before(frame_idx) > parked_frame) {
+            return false;
+        }
+        bool found = frame_idx == parked_frame;  // Still in `frame`
+        while (!found && decode_next_frame()) found = frame_number(frame) >= frame_idx;
+        if (!found) return false;
+
+        has_pending_frame = true;
+        current_frame.store(frame_idx, std::memory_order_release);
+        next_frame_index.store(frame_idx, std::memory_order_relaxed);
+        last_pushed_seconds = -1.0;
+        return true;
+    }
+
+    // Phase 12: Frame-exact seek. Jumps to the nearest keyframe at or before the
+    // target and decodes forward, without conversion, until the target frame.
+    void seek_internal(int frame_idx) {
+        auto t0 = std::chrono::steady_clock::now();
+        has_pending_frame = false;
+        input_eof = false;
+
+        if (sequence) {
+            // Phase 23: every still is a keyframe; loading restarts from the target
+            frame_idx = std::clamp(frame_idx, 0, std::max(0, total_frames - 1));
+            sequence->seek(frame_idx);
+            current_frame.store(frame_idx, std::memory_order_release);
+            next_frame_index.store(frame_idx, std::memory_order_relaxed);
+            last_pushed_seconds = -1.0;
+            stats.last_seek_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            stats.last_seek_decoded = 0;
+            stats.seeks++;
+            return;
+        }
+
+        AVStream* stream = fmt_ctx->streams[video_stream_idx];
+
+        if (!has_index()) {
+            // No index (yet): time-based seek, landing on whatever keyframe precedes it.
+            // VFR and badly tagged files may have no average rate; without any rate
+            // there is no way to place a frame number in time.
+            AVRational rate = stream->avg_frame_rate;
+            if (rate.num <= 0 || rate.den <= 0) rate = stream->r_frame_rate;
+            if (rate.num <= 0 || rate.den <= 0) {
+                std::cerr << "Cannot seek before indexing: stream has no frame rate\n";
+                return;
+            }
+            int last = total_frames.load(std::memory_order_relaxed) - 1;
+            frame_idx = std::max(0, last >= 0 ? std::min(frame_idx, last) : frame_idx);
+            int64_t ts = av_rescale_q(frame_idx, av_inv_q(rate), stream->time_base);
+            if (stream->start_time != AV_NOPTS_VALUE) ts += stream->start_time;
+            av_seek_frame(fmt_ctx, video_stream_idx, ts, AVSEEK_FLAG_BACKWARD);
+            avcodec_flush_buffers(codec_ctx);
+            current_frame.store(frame_idx, std::memory_order_release);
+            next_frame_index.store(frame_idx, std::memory_order_relaxed);
+            last_pushed_seconds = -1.0;
+
+            float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            stats.last_seek_ms = ms;
+            stats.max_seek_ms = std::max(stats.max_seek_ms.load(), ms);
+            stats.last_seek_decoded = 0;
+            stats.seeks++;
+            return;
+        }
+
+        frame_idx = std::clamp(frame_idx, 0, (int)index.frame_pts.size() - 1);
+        int key_idx = index.keyframe_before(frame_idx);
+        int64_t target_pts = index.frame_pts[frame_idx];
+        av_seek_frame(fmt_ctx, video_stream_idx, index.frame_pts[key_idx], AVSEEK_FLAG_BACKWARD);
+        avcodec_flush_buffers(codec_ctx);
+
+        uint32_t decoded = 0;
+        while (decode_next_frame()) {
+            ++decoded;
+            int64_t ts = frame_timestamp(frame);
+            if (ts == AV_NOPTS_VALUE || ts >= target_pts) {
+                has_pending_frame = true;  // Hand this frame out on the next decode call
+                break;
+            }
+        }
+
+        current_frame.store(frame_idx, std::memory_order_release);
+        next_frame_index.store(frame_idx, std::memory_order_relaxed);
+        last_pushed_seconds = -1.0;
+
+        float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        stats.last_seek_ms = ms;
+        stats.max_seek_ms = std::max(stats.max_seek_ms.load(), ms);
+        stats.last_seek_decoded = decoded;
+        stats.seeks++;
+    }
+
+    // Phase 10: Start decoding ahead of the render loop into a ring of `depth` frames.
+    // Phase 15: with `external` set, slot i lives at external + i * slot_stride
+    // (GL-mapped staging memory) and slots are retired by the render thread.
+    // Phase 16: the decoder is stepped by the shared pool instead of its own thread.
+    void start_async(DecoderPool& decode_pool, size_t depth, uint8_t* external = nullptr, size_t slot_stride = 0) {
+        if (worker_running || (!codec_ctx && !sequence)) return;
+
+        ring.reset(depth);
+        ring.set_deferred_retire(external != nullptr);
+        // Reading back write-combined mapped memory is slow, so mapped slots aren't cached
+        cache_decoded = cache_enabled && external == nullptr;
+        for (size_t i = 0; i < depth; ++i) {
+            DecodedFrame& slot = ring.slot(i);
+            slot.layout = output_layout;
+            slot.width = width;
+            slot.height = height;
+            if (external) {
+                slot.set_packed_planes(external + i * slot_stride);
+            } else {
+                slot.storage.resize(layout_frame_bytes(output_layout, width, height));
+                slot.set_packed_planes(slot.storage.data());
+            }
+        }
+        stats.ring_capacity = depth;
+        next_frame_index.store(current_frame.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        // Phase 19: preroll slots match the ring layout; captured again on the next pass
+        preroll.assign(kPrerollFrames, DecodedFrame());
+        for (DecodedFrame& p : preroll) {
+            p.layout = output_layout;
+            p.width = width;
+            p.height = height;
+            p.storage.resize(layout_frame_bytes(output_layout, width, height));
+            p.set_packed_planes(p.storage.data());
+        }
+        preroll_in = -1;
+        preroll_count = 0;
+        preroll_pos = -1;
+        loop_seek_pending = false;
+        {
+            // Phase 21: warm frame in the ring layout, never in mapped memory
+            std::lock_guard<std::mutex> lock(warm_mutex);
+            warm.layout = output_layout;
+            warm.width = width;
+            warm.height = height;
+            warm.storage.resize(layout_frame_bytes(output_layout, width, height));
+            warm.set_packed_planes(warm.storage.data());
+            warm_index = -1;
+        }
+        warm_target = -1;
+        parked_frame = -1;
+        worker_eof = false;
+        seek_request = -1;
+        worker_running = true;
+        pool = &decode_pool;
+        pool->add(this);
+        if (sequence) sequence->start(decode_pool, std::max(1, ffmpeg_threads));  // Phase 23
+    }
+
+    // Slots stay allocated (and their fences alive) until the next start_async()
+    void stop_async() {
+        if (!pool) return;
+        pool->remove(this);
+        if (sequence) sequence->stop();
+        pool = nullptr;
+        worker_running = false;
+        // Phase 19: the synchronous path loops by seeking; the timeline offset carries over
+        preroll.clear();
+        preroll_in = -1;
+        preroll_count = 0;
+        preroll_pos = -1;
+        loop_seek_pending = false;
+        stats.ring_capacity = 0;
+        stats.ring_depth = 0;
+    }
+
+    // Phase 16: One unit of decode work, run by whichever pool thread picks us up
+    bool step() override {
+        int frame_serial = serial.load();
+        int seek_target = seek_request.exchange(-1);
+        if (seek_target >= 0) {
+            if (!(resume_request.exchange(false) && catch_up_to(seek_target))) seek_internal(seek_target);
+            reset_loop_state();
+            loop_offset_seconds = seek_offset_request.load();
+            worker_eof = false;
+            warm_target = -1;
+            parked_frame = -1;
+        }
+        if (suspended) return step_warm() || seek_target >= 0;
+        parked_frame = -1;
+
+        // Phase 11: don't decode further ahead of the clock than we need to
+        bool far_enough_ahead = last_pushed_seconds >= 0.0 &&
+                                last_pushed_seconds - clock_seconds.load() > max_decode_ahead;
+        DecodedFrame* slot = (worker_eof || far_enough_ahead) ? nullptr : ring.begin_push();
+        if (!slot) {
+            // Phase 19: with the ring full, the seek behind a loop join costs nothing
+            if (loop_seek_pending) {
+                resume_after_preroll();
+                return true;
+            }
+            // Ring full, far enough ahead, or nothing left to decode
+            return seek_target >= 0;
+        }
+
+        // Phase 19: after a join, the pre-rolled in-point frames go out first
+        if (preroll_pos >= 0) {
+            slot->copy_from(preroll[preroll_pos]);
+            push_decoded(*slot, frame_serial);
+            if (++preroll_pos == preroll_count) {
+                preroll_pos = -1;
+                if (loop_seek_pending) resume_after_preroll();
+            }
+            return true;
+        }
+
+        // Phase 23: the next still is still being loaded by another task; don't wait on it here
+        if (sequence && sequence->next_loading()) return false;
+
+        auto t0 = std::chrono::steady_clock::now();
+        bool got_frame = decode_next_frame();
+        int frame_idx = got_frame ? frame_number(frame) : -1;
+        if (loop_enabled && (!got_frame || frame_idx > loop_end_frame())) {
+            join_loop();
+            return true;
+        }
+        if (!got_frame) {
+            worker_eof = true;
+            return true;
+        }
+
+        auto t_convert = std::chrono::steady_clock::now();
+        convert_frame(*slot);
+        stats.last_convert_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t_convert).count();
+
+        slot->frame_index = frame_idx;
+        slot->pts_seconds = frame_seconds(frame);
+        if (cache_decoded) cache.insert(*slot);  // Cached with source PTS, before any loop offset
+        capture_preroll(*slot);
+        push_decoded(*slot, frame_serial);
+
+        auto t1 = std::chrono::steady_clock::now();
+        stats.last_decode_ms = std::chrono::duration<float, std::milli>(t1 - t0).count();
+        stats.frames_decoded++;
+        return true;
+    }
+
+    // Phase 21: While suspended, keep the warm frame on the requested show time.
+    // The worker decodes forward one frame per step from the parked frame, seeking
+    // only when the target left its GOP, and converts just the frame it lands on.
+    bool step_warm() {
+        double t = warm_request.exchange(-1.0);
+        if (t >= 0.0) {
+            int target = frame_at_seconds(loop_source_seconds(t, loop_offset_seconds));
+            if (!has_index() || parked_frame < 0 || target < parked_frame ||
+                index.keyframe_before(target) > parked_frame) {
+                seek_internal(target);
+                parked_frame = -1;
+            }
+            preroll_pos = -1;
+            loop_seek_pending = false;
+            warm_target = target;
+        }
+        if (warm_target < 0) return false;
+
+        if (parked_frame < warm_target) {
+            if (!decode_next_frame()) {
+                warm_target = -1;
+                return true;
+            }
+            parked_frame = frame_number(frame);
+            if (parked_frame < warm_target) return true;
+        }
+        warm_target = -1;
+
+        std::lock_guard<std::mutex> lock(warm_mutex);
+        if (warm_index == parked_frame) return true;
+        convert_frame(warm);
+        warm.frame_index = parked_frame;
+        last_raw_seconds = frame_seconds(frame);
+        warm.pts_seconds = last_raw_seconds + loop_offset_seconds;
+        warm_index = parked_frame;
+        return true;
+    }
+
+    // Phase 19: Source seconds for timeline seconds `t`. When looping, whole
+    // loops before `t` go into `offset` (timeline = source PTS + offset), the
+    // same offset join_loop() would have reached playing up to `t`.
+    double loop_source_seconds(double t, double& offset) const {
+        offset = 0.0;
+        if (!loop_enabled) return t;
+        double end = frame_index_seconds(loop_end_frame()) + frame_duration;
+        double length = end - frame_index_seconds(loop_in);
+        if (length <= 0.0 || t < end) return t;
+        offset = (std::floor((t - end) / length) + 1.0) * length;
+        return t - offset;
+    }
+
+    // Phase 19: Last frame played before looping back to the in-point
+    int loop_end_frame() const {
+        int last = std::max(0, total_frames - 1);
+        int out = loop_out.load();
+        return out < 0 ? last : std::min(out, last);
+    }
+
+    // A user seek puts the timeline back on source time
+    void reset_loop_state() {
+        loop_offset_seconds = 0.0;
+        preroll_pos = -1;
+        loop_seek_pending = false;
+    }
+
+    // Stamps the slot (holding source PTS) with timeline PTS and publishes it
+    void push_decoded(DecodedFrame& slot, int frame_serial) {
+        last_raw_seconds = slot.pts_seconds;
+        slot.pts_seconds += loop_offset_seconds;
+        slot.serial = frame_serial;
+        last_pushed_seconds = slot.pts_seconds;
+        ring.end_push();
+    }
+
+    // Keeps the first frames after the in-point as they pass by, so the next join
+    // can hand them out while the demuxer seeks
+    void capture_preroll(const DecodedFrame& f) {
+        int in = loop_in.load();
+        if (preroll.empty()) return;
+        if (preroll_in != in) {
+            preroll_in = in;
+            preroll_count = 0;
+        }
+        // Leave at least one frame of the loop to come from the file after the preroll
+        int wanted = std::min((int)preroll.size(), loop_end_frame() - in);
+        if (preroll_count < wanted && f.frame_index == in + preroll_count) {
+            preroll[preroll_count++].copy_from(f);
+        }
+    }
+
+    // The frame past the out-point (or EOF) was reached: continue from the in-point
+    // on the timeline, from the preroll if it's complete, otherwise by seeking now
+    void join_loop() {
+        int in = loop_in.load();
+        loop_offset_seconds += last_raw_seconds + frame_duration - frame_index_seconds(in);
+        stats.loops++;
+        int wanted = std::min((int)preroll.size(), loop_end_frame() - in);
+        if (preroll_in == in && wanted > 0 && preroll_count == wanted) {
+            preroll_pos = 0;
+            loop_seek_pending = true;
+            return;
+        }
+        seek_internal(in);
+    }
+
+    void resume_after_preroll() {
+        seek_internal(preroll_in + preroll_count);
+        loop_seek_pending = false;
+    }
+
+    // Phase 19: Render side. Every frame leaving the ring should be exactly one
+    // frame after the one before it, across loop joins included.
+    void note_output(const DecodedFrame& f) {
+        if (f.serial == last_output_serial && last_output_seconds >= 0.0) {
+            double delta = f.pts_seconds - last_output_seconds;
+            if (delta < frame_duration * 0.5) stats.loop_dups++;
+            else if (delta > frame_duration * 1.5) stats.loop_gaps++;
+        }
+        last_output_serial = f.serial;
+        last_output_seconds = f.pts_seconds;
+    }
+
+    // Phase 10: Render-thread side. Returns the next frame from the current seek
+    // generation without touching FFmpeg, or nullptr if none is ready.
+    DecodedFrame* peek_decoded() {
+        DecodedFrame* f = ring.front();
+        while (f && f->serial != serial.load()) {
+            ring.pop();  // Decoded before the last seek
+            f = ring.front();
+        }
+        return f;
+    }
+
+    // Phase 11: Pick the newest queued frame whose PTS has been reached at
+    // `clock` and drop anything older. Returns nullptr when the frame on screen
+    // is still the right one (or nothing is ready yet).
+    DecodedFrame* select_decoded(double clock) {
+        DecodedFrame* f = peek_decoded();
+        if (!f || f->pts_seconds > clock) return nullptr;
+
+        size_t due = 0;
+        while (DecodedFrame* next = ring.peek(due + 1)) {
+            if (next->serial != f->serial || next->pts_seconds > clock) break;
+            ++due;
+        }
+        for (size_t i = 0; i < due; ++i) {
+            note_output(*ring.front());
+            ring.pop();
+        }
+        stats.frames_dropped += due;
+        note_output(*ring.front());
+        return ring.front();
+    }
+
+    void release_decoded() {
+        ring.pop();
+    }
+
+    void update_ring_stats(double on_screen_seconds) {
+        stats.ring_depth = ring.size();
+        DecodedFrame* newest = ring.back();
+        stats.decode_ahead_sec = newest ? std::max(0.0, newest->pts_seconds - on_screen_seconds) : 0.0;
+    }
+};
+
+// Phase 25: Block-compressed stills. Imported images are encoded once on the CPU
+// to BC1 (opaque) or BC7/BC3 (with alpha), mip chain included, and cached on
+// disk by content hash, so later loads are a straight compressed upload.
+// BC7 uses mode 6 only (one subset, RGBA endpoints, 4-bit indices).
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+enum class BlockFormat : uint32_t { RGBA8 = 0, BC1 = 1, BC3 = 3, BC7 = 7 };
+
+inline const char* block_format_name(BlockFormat format) {
+    switch (format) {
+        case BlockFormat::BC1: return "BC1";
+        case BlockFormat::BC3: return "BC3";
+        case BlockFormat::BC7: return "BC7";
+        default: return "RGBA8";
+    }
+}
+
+inline GLenum block_format_gl(BlockFormat format) {
+    switch (format) {
+        case BlockFormat::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case BlockFormat::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case BlockFormat::BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        default: return GL_RGBA8;
+    }
+}
+
+// Bytes per 4x4 block, or per pixel for RGBA8
+inline size_t block_format_bytes(BlockFormat format) {
+    return format == BlockFormat::BC1 ? 8 : format == BlockFormat::RGBA8 ? 4 : 16;
+}
+
+// Bytes in one row of blocks (one row of pixels for RGBA8) and how many such rows a level has
+inline void block_rows(BlockFormat format, int width, int height, size_t& row_bytes, int& rows) {
+    if (format == BlockFormat::RGBA8) {
+        row_bytes = (size_t)width * 4;
+        rows = height;
+    } else {
+        row_bytes = (size_t)((width + 3) / 4) * block_format_bytes(format);
+        rows = (height + 3) / 4;
+    }
+}
+
+// 64-bit FNV-1a, used as the content key of cached textures
+inline uint64_t fnv1a64(const uint8_t* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// An image in upload order: every mip level's blocks (or pixels) back to back
+struct CompressedImage {
+    static constexpr char kMagic[8] = {'V', 'L', 'X', 'T', 'E', 'X', '1', '\0'};
+
+    struct Level {
+        int width = 0, height = 0;
+        size_t offset = 0, size = 0;
+    };
+
+    BlockFormat format = BlockFormat::RGBA8;
+    int width = 0, height = 0;
+    std::vector<Level> levels;
+    std::vector<uint8_t> data;
+
+    bool empty() const { return levels.empty(); }
+
+    bool save(const std::string& path, uint64_t content_hash) const {
+        std::ofstream out(path, std::ios::binary);
+        if (!out) return false;
+        uint32_t fmt = (uint32_t)format, level_count = (uint32_t)levels.size();
+        uint64_t data_size = data.size();
+        out.write(kMagic, sizeof(kMagic));
+        out.write((const char*)&content_hash, sizeof(content_hash));
+        out.write((const char*)&fmt, sizeof(fmt));
+        out.write((const char*)&width, sizeof(width));
+        out.write((const char*)&height, sizeof(height));
+        out.write((const char*)&level_count, sizeof(level_count));
+        out.write((const char*)&data_size, sizeof(data_size));
+        out.write((const char*)data.data(), data.size());
+        return (bool)out;
+    }
+
+    // Fails if the file is missing, corrupt or was written for other content.
+    // Level layout isn't stored; it follows from the format and size.
+    bool load(const std::string& path, uint64_t content_hash) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return false;
+        char magic[sizeof(kMagic)] = {};
+        uint64_t hash = 0, data_size = 0;
+        uint32_t fmt = 0, level_count = 0;
+        int w = 0, h = 0;
+        in.read(magic, sizeof(magic));
+        in.read((char*)&hash, sizeof(hash));
+        in.read((char*)&fmt, sizeof(fmt));
+        in.read((char*)&w, sizeof(w));
+        in.read((char*)&h, sizeof(h));
+        in.read((char*)&level_count, sizeof(level_count));
+        in.read((char*)&data_size, sizeof(data_size));
+        if (!in || memcmp(magic, kMagic, sizeof(kMagic)) != 0 || hash != content_hash) return false;
+        if (w <= 0 || h <= 0 || w > 65536 || h > 65536 || level_count == 0 || level_count > 17) return false;
+        if (fmt != 1 && fmt != 3 && fmt != 7) return false;
+
+        format = (BlockFormat)fmt;
+        set_layout(w, h, (int)level_count);
+        if (data.size() != data_size) return false;
+        in.read((char*)data.data(), data.size());
+        return (bool)in;
+    }
+
+    // Sizes `data` and fills in the level table for a chain of `level_count` mips
+    void set_layout(int w, int h, int level_count) {
+        width = w;
+        height = h;
+        levels.clear();
+        size_t offset = 0;
+        for (int i = 0; i < level_count; ++i) {
+            Level level;
+            level.width = std::max(1, w >> i);
+            level.height = std::max(1, h >> i);
+            size_t row_bytes;
+            int rows;
+            block_rows(format, level.width, level.height, row_bytes, rows);
+            level.offset = offset;
+            level.size = row_bytes * rows;
+            offset += level.size;
+            levels.push_back(level);
+        }
+        data.assign(offset, 0);
+    }
+};
+
+inline int full_mip_count(int w, int h) {
+    int count = 1;
+    while (w > 1 || h > 1) {
+        w = std::max(1, w / 2);
+        h = std::max(1, h / 2);
+        ++count;
+    }
+    return count;
+}
+
+inline bool rgba_has_alpha(const uint8_t* rgba, size_t pixels) {
+    for (size_t i = 0; i < pixels; ++i) {
+        if (rgba[i * 4 + 3] != 255) return true;
+    }
+    return false;
+}
+
+// 2x2 box filter to the next mip level; odd edges reuse the last row/column
+inline void downsample_rgba(const uint8_t* src, int w, int h, std::vector<uint8_t>& dst, int& dw, int& dh) {
+    dw = std::max(1, w / 2);
+    dh = std::max(1, h / 2);
+    dst.resize((size_t)dw * dh * 4);
+    for (int y = 0; y < dh; ++y) {
+        int y0 = std::min(y * 2, h - 1), y1 = std::min(y * 2 + 1, h - 1);
+        for (int x = 0; x < dw; ++x) {
+            int x0 = std::min(x * 2, w - 1), x1 = std::min(x * 2 + 1, w - 1);
+            for (int c = 0; c < 4; ++c) {
+                int sum = src[((size_t)y0 * w + x0) * 4 + c] + src[((size_t)y0 * w + x1) * 4 + c] +
+                          src[((size_t)y1 * w + x0) * 4 + c] + src[((size_t)y1 * w + x1) * 4 + c];
+                dst[((size_t)y * dw + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+// Block encoders work on 16 RGBA pixels in row order
+namespace bc {
+
+// Endpoints of the block's principal axis over the first `channels` channels
+inline void principal_endpoints(const uint8_t px[64], int channels, float e0[4], float e1[4]) {
+    float mean[4] = {0, 0, 0, 0};
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < channels; ++c) mean[c] += px[i * 4 + c] / 16.0f;
+    }
+    float cov[4][4] = {};
+    for (int i = 0; i < 16; ++i) {
+        float d[4];
+        for (int c = 0; c < channels; ++c) d[c] = px[i * 4 + c] - mean[c];
+        for (int a = 0; a < channels; ++a) {
+            for (int b = 0; b < channels; ++b) cov[a][b] += d[a] * d[b];
+        }
+    }
+    // Power iteration, starting from the channel with the widest spread
+    float axis[4] = {0, 0, 0, 0};
+    int widest = 0;
+    for (int c = 1; c < channels; ++c) {
+        if (cov[c][c] > cov[widest][widest]) widest = c;
+    }
+    axis[widest] = 1.0f;
+    for (int iter = 0; iter < 8; ++iter) {
+        float next[4] = {0, 0, 0, 0};
+        float len = 0.0f;
+        for (int a = 0; a < channels; ++a) {
+            for (int b = 0; b < channels; ++b) next[a] += cov[a][b] * axis[b];
+            len += next[a] * next[a];
+        }
+        if (len < 1e-12f) break;
+        len = std::sqrt(len);
+        for (int a = 0; a < channels; ++a) axis[a] = next[a] / len;
+    }
+    float tmin = 0.0f, tmax = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+        float t = 0.0f;
+        for (int c = 0; c < channels; ++c) t += (px[i * 4 + c] - mean[c]) * axis[c];
+        tmin = std::min(tmin, t);
+        tmax = std::max(tmax, t);
+    }
+    for (int c = 0; c < channels; ++c) {
+        e0[c] = std::clamp(mean[c] + axis[c] * tmax, 0.0f, 255.0f);
+        e1[c] = std::clamp(mean[c] + axis[c] * tmin, 0.0f, 255.0f);
+    }
+}
+
+inline uint16_t pack_565(const float c[3]) {
+    int r = std::clamp((int)std::lround(c[0] * 31.0f / 255.0f), 0, 31);
+    int g = std::clamp((int)std::lround(c[1] * 63.0f / 255.0f), 0, 63);
+    int b = std::clamp((int)std::lround(c[2] * 31.0f / 255.0f), 0, 31);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+inline void unpack_565(uint16_t v, int out[3]) {
+    int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+    out[0] = (r << 3) | (r >> 2);
+    out[1] = (g << 2) | (g >> 4);
+    out[2] = (b << 3) | (b >> 2);
+}
+
+inline void write_le(uint8_t* out, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; ++i) out[i] = (uint8_t)(v >> (8 * i));
+}
+
+inline uint64_t read_le(const uint8_t* in, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; ++i) v |= (uint64_t)in[i] << (8 * i);
+    return v;
+}
+
+// Four-colour BC1 block (c0 > c1); also the colour half of BC3
+inline void encode_bc1(const uint8_t px[64], uint8_t out[8]) {
+    float e0[4], e1[4];
+    principal_endpoints(px, 3, e0, e1);
+    uint16_t c0 = pack_565(e0), c1 = pack_565(e1);
+    if (c0 < c1) std::swap(c0, c1);
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        int p[4][3];
+        unpack_565(c0, p[0]);
+        unpack_565(c1, p[1]);
+        for (int c = 0; c < 3; ++c) {
+            p[2][c] = (2 * p[0][c] + p[1][c]) / 3;
+            p[3][c] = (p[0][c] + 2 * p[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; ++i) {
+            int best = 0, best_err = INT32_MAX;
+            for (int k = 0; k < 4; ++k) {
+                int err = 0;
+                for (int c = 0; c < 3; ++c) err += (px[i * 4 + c] - p[k][c]) * (px[i * 4 + c] - p[k][c]);
+                if (err < best_err) {
+                    best_err = err;
+                    best = k;
+                }
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+    write_le(out, c0, 2);
+    write_le(out + 2, c1, 2);
+    write_le(out + 4, indices, 4);
+}
+
+// Eight-value alpha block (a0 > a1) of BC3
+inline void encode_bc3_alpha(const uint8_t px[64], uint8_t out[8]) {
+    int a0 = 0, a1 = 255;
+    for (int i = 0; i < 16; ++i) {
+        a0 = std::max(a0, (int)px[i * 4 + 3]);
+        a1 = std::min(a1, (int)px[i * 4 + 3]);
+    }
+    uint64_t indices = 0;
+    if (a0 != a1) {
+        int palette[8] = {a0, a1};
+        for (int k = 1; k < 7; ++k) palette[k + 1] = ((7 - k) * a0 + k * a1) / 7;
+        for (int i = 0; i < 16; ++i) {
+            int best = 0, best_err = INT32_MAX;
+            for (int k = 0; k < 8; ++k) {
+                int err = std::abs(px[i * 4 + 3] - palette[k]);
+                if (err < best_err) {
+                    best_err = err;
+                    best = k;
+                }
+            }
+            indices |= (uint64_t)best << (3 * i);
+        }
+    }
+    out[0] = (uint8_t)a0;
+    out[1] = (uint8_t)a1;
+    write_le(out + 2, indices, 6);
+}
+
+inline void encode_bc3(const uint8_t px[64], uint8_t out[16]) {
+    encode_bc3_alpha(px, out);
+    encode_bc1(px, out + 8);
+}
+
+constexpr int kBc7Weights4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// Appends bits to a 128-bit block, least significant first
+struct BitWriter {
+    uint8_t* out;
+    int pos = 0;
+    void write(uint32_t value, int bits) {
+        for (int i = 0; i < bits; ++i, ++pos) {
+            if (value & (1u << i)) out[pos / 8] |= (uint8_t)(1u << (pos % 8));
+        }
+    }
+};
+
+struct BitReader {
+    const uint8_t* in;
+    int pos = 0;
+    uint32_t read(int bits) {
+        uint32_t value = 0;
+        for (int i = 0; i < bits; ++i, ++pos) value |= (uint32_t)((in[pos / 8] >> (pos % 8)) & 1) << i;
+        return value;
+    }
+};
+
+// BC7 mode 6: 7-bit RGBA endpoints with one p-bit each, 4-bit indices
+inline void encode_bc7(const uint8_t px[64], uint8_t out[16]) {
+    float e[2][4];
+    principal_endpoints(px, 4, e[0], e[1]);
+
+    // Quantise each endpoint, picking the p-bit that lands closest
+    int q[2][4], p[2], full[2][4];
+    for (int n = 0; n < 2; ++n) {
+        float best_err = 1e30f;
+        for (int pbit = 0; pbit < 2; ++pbit) {
+            int cand[4];
+            float err = 0.0f;
+            for (int c = 0; c < 4; ++c) {
+                cand[c] = std::clamp((int)std::lround((e[n][c] - pbit) / 2.0f), 0, 127);
+                float d = (float)((cand[c] << 1) | pbit) - e[n][c];
+                err += d * d;
+            }
+            if (err < best_err) {
+                best_err = err;
+                p[n] = pbit;
+                for (int c = 0; c < 4; ++c) q[n][c] = cand[c];
+            }
+        }
+        for (int c = 0; c < 4; ++c) full[n][c] = (q[n][c] << 1) | p[n];
+    }
+
+    int palette[16][4];
+    for (int k = 0; k < 16; ++k) {
+        for (int c = 0; c < 4; ++c) {
+            palette[k][c] = ((64 - kBc7Weights4[k]) * full[0][c] + kBc7Weights4[k] * full[1][c] + 32) >> 6;
+        }
+    }
+    int indices[16];
+    for (int i = 0; i < 16; ++i) {
+        int best = 0, best_err = INT32_MAX;
+        for (int k = 0; k < 16; ++k) {
+            int err = 0;
+            for (int c = 0; c < 4; ++c) err += (px[i * 4 + c] - palette[k][c]) * (px[i * 4 + c] - palette[k][c]);
+            if (err < best_err) {
+                best_err = err;
+                best = k;
+            }
+        }
+        indices[i] = best;
+    }
+    // The first index is stored without its top bit, so it must be < 8
+    if (indices[0] >= 8) {
+        std::swap(q[0], q[1]);
+        std::swap(p[0], p[1]);
+        for (int& idx : indices) idx = 15 - idx;
+    }
+
+    memset(out, 0, 16);
+    BitWriter bits{out};
+    bits.write(1u << 6, 7);  // Mode 6: six zero bits, then a one
+    for (int c = 0; c < 4; ++c) {
+        bits.write(q[0][c], 7);
+        bits.write(q[1][c], 7);
+    }
+    bits.write(p[0], 1);
+    bits.write(p[1], 1);
+    bits.write(indices[0], 3);
+    for (int i = 1; i < 16; ++i) bits.write(indices[i], 4);
+}
+
+// Decoders for the blocks above, for round-trip checks without a GPU
+inline void decode_bc1(const uint8_t in[8], uint8_t px[64], bool four_color_only) {
+    uint16_t c0 = (uint16_t)read_le(in, 2), c1 = (uint16_t)read_le(in + 2, 2);
+    uint32_t indices = (uint32_t)read_le(in + 4, 4);
+    int p[4][4];
+    unpack_565(c0, p[0]);
+    unpack_565(c1, p[1]);
+    p[0][3] = p[1][3] = p[2][3] = p[3][3] = 255;
+    for (int c = 0; c < 3; ++c) {
+        if (c0 > c1 || four_color_only) {
+            p[2][c] = (2 * p[0][c] + p[1][c]) / 3;
+            p[3][c] = (p[0][c] + 2 * p[1][c]) / 3;
+        } else {
+            p[2][c] = (p[0][c] + p[1][c]) / 2;
+            p[3][c] = 0;
+        }
+    }
+    if (!(c0 > c1 || four_color_only)) p[3][3] = 0;
+    for (int i = 0; i < 16; ++i) {
+        int k = (indices >> (2 * i)) & 3;
+        for (int c = 0; c < 4; ++c) px[i * 4 + c] = (uint8_t)p[k][c];
+    }
+}
+
+inline void decode_bc3(const uint8_t in[16], uint8_t px[64]) {
+    decode_bc1(in + 8, px, true);
+    int a0 = in[0], a1 = in[1];
+    int palette[8] = {a0, a1};
+    if (a0 > a1) {
+        for (int k = 1; k < 7; ++k) palette[k + 1] = ((7 - k) * a0 + k * a1) / 7;
+    } else {
+        for (int k = 1; k < 5; ++k) palette[k + 1] = ((5 - k) * a0 + k * a1) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+    uint64_t indices = read_le(in + 2, 6);
+    for (int i = 0; i < 16; ++i) px[i * 4 + 3] = (uint8_t)palette[(indices >> (3 * i)) & 7];
+}
+
+// Mode 6 only; other modes decode as magenta so a stray block is obvious
+inline void decode_bc7(const uint8_t in[16], uint8_t px[64]) {
+    BitReader bits{in};
+    if (bits.read(7) != (1u << 6)) {
+        for (int i = 0; i < 16; ++i) write_le(px + i * 4, 0xFFFF00FFu, 4);
+        return;
+    }
+    int q[2][4], p[2], full[2][4];
+    for (int c = 0; c < 4; ++c) {
+        q[0][c] = (int)bits.read(7);
+        q[1][c] = (int)bits.read(7);
+    }
+    p[0] = (int)bits.read(1);
+    p[1] = (int)bits.read(1);
+    for (int n = 0; n < 2; ++n) {
+        for (int c = 0; c < 4; ++c) full[n][c] = (q[n][c] << 1) | p[n];
+    }
+    for (int i = 0; i < 16; ++i) {
+        int k = (int)bits.read(i == 0 ? 3 : 4);
+        for (int c = 0; c < 4; ++c) {
+            px[i * 4 + c] = (uint8_t)(((64 - kBc7Weights4[k]) * full[0][c] + kBc7Weights4[k] * full[1][c] + 32) >> 6);
+        }
+    }
+}
+
+}  // namespace bc
+
+// Encodes RGBA pixels (and, with `mips`, a box-filtered chain down to 1x1)
+inline CompressedImage compress_rgba(const uint8_t* rgba, int width, int height, BlockFormat format, bool mips) {
+    CompressedImage image;
+    image.format = format;
+    image.set_layout(width, height, mips ? full_mip_count(width, height) : 1);
+
+    std::vector<uint8_t> level_pixels, next_pixels;
+    const uint8_t* src = rgba;
+    size_t block_size = block_format_bytes(format);
+    for (size_t l = 0; l < image.levels.size(); ++l) {
+        const CompressedImage::Level& level = image.levels[l];
+        uint8_t* dst = image.data.data() + level.offset;
+        if (format == BlockFormat::RGBA8) {
+            memcpy(dst, src, level.size);
+        } else {
+            int blocks_x = (level.width + 3) / 4, blocks_y = (level.height + 3) / 4;
+            uint8_t block[64];
+            for (int by = 0; by < blocks_y; ++by) {
+                for (int bx = 0; bx < blocks_x; ++bx) {
+                    // Edge blocks repeat the last row/column
+                    for (int i = 0; i < 16; ++i) {
+                        int x = std::min(bx * 4 + i % 4, level.width - 1);
+                        int y = std::min(by * 4 + i / 4, level.height - 1);
+                        memcpy(block + i * 4, src + ((size_t)y * level.width + x) * 4, 4);
+                    }
+                    uint8_t* out = dst + ((size_t)by * blocks_x + bx) * block_size;
+                    if (format == BlockFormat::BC1) bc::encode_bc1(block, out);
+                    else if (format == BlockFormat::BC3) bc::encode_bc3(block, out);
+                    else bc::encode_bc7(block, out);
+                }
+            }
+        }
+        if (l + 1 < image.levels.size()) {
+            int nw, nh;
+            downsample_rgba(src, level.width, level.height, next_pixels, nw, nh);
+            level_pixels.swap(next_pixels);
+            src = level_pixels.data();
+        }
+    }
+    return image;
+}
+
+// Decodes one level back to RGBA, for checking an encoding on the CPU
+inline std::vector<uint8_t> decompress_level(const CompressedImage& image, int level_idx) {
+    const CompressedImage::Level& level = image.levels[level_idx];
+    const uint8_t* src = image.data.data() + level.offset;
+    std::vector<uint8_t> rgba((size_t)level.width * level.height * 4);
+    if (image.format == BlockFormat::RGBA8) {
+        memcpy(rgba.data(), src, rgba.size());
+        return rgba;
+    }
+    int blocks_x = (level.width + 3) / 4, blocks_y = (level.height + 3) / 4;
+    size_t block_size = block_format_bytes(image.format);
+    uint8_t block[64];
+    for (int by = 0; by < blocks_y; ++by) {
+        for (int bx = 0; bx < blocks_x; ++bx) {
+            const uint8_t* in = src + ((size_t)by * blocks_x + bx) * block_size;
+            if (image.format == BlockFormat::BC1) bc::decode_bc1(in, block, false);
+            else if (image.format == BlockFormat::BC3) bc::decode_bc3(in, block);
+            else bc::decode_bc7(in, block);
+            for (int i = 0; i < 16; ++i) {
+                int x = bx * 4 + i % 4, y = by * 4 + i / 4;
+                if (x < level.width && y < level.height) memcpy(&rgba[((size_t)y * level.width + x) * 4], block + i * 4, 4);
+            }
+        }
+    }
+    return rgba;
+}
+
+// Peak signal-to-noise ratio over all four channels, in dB
+inline double rgba_psnr(const uint8_t* a, const uint8_t* b, size_t pixels) {
+    double sum = 0.0;
+    for (size_t i = 0; i < pixels * 4; ++i) {
+        double d = (double)a[i] - (double)b[i];
+        sum += d * d;
+    }
+    double mse = sum / (double)(pixels * 4);
+    return mse <= 0.0 ? 99.0 : 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+// Phase 29: Owns one GL texture name. Move-only; the name is deleted with its owner.
+class GlTexture {
+public:
+    GlTexture() = default;
+    ~GlTexture() { reset(); }
+    GlTexture(const GlTexture&) = delete;
+    GlTexture& operator=(const GlTexture&) = delete;
+    GlTexture(GlTexture&& other) noexcept : id(std::exchange(other.id, 0)) {}
+    GlTexture& operator=(GlTexture&& other) noexcept {
+        if (this != &other) {
+            reset();
+            id = std::exchange(other.id, 0);
+        }
+        return *this;
+    }
+
+    GLuint create() {
+        reset();
+        glGenTextures(1, &id);
+        return id;
+    }
+
+    void reset() {
+        if (id) glDeleteTextures(1, &id);
+        id = 0;
+    }
+
+    GLuint get() const { return id; }
+    explicit operator bool() const { return id != 0; }
+
+private:
+    GLuint id = 0;
+};
+
+// Phase 26: Very large stills as a pyramid of bordered tiles. The pyramid is
+// built (and block-compressed) on load; at draw time each quad picks the level
+// matching its on-screen size and only the tiles it samples are made resident.
+// Tiles nobody drew for a while are evicted; the coarsest level, a single tile,
+// stays resident and covers any tile that hasn't streamed in yet.
+struct TiledImage {
+    static constexpr int kTileSize = 1024;      // Content texels per tile edge
+    static constexpr int kBorder = 4;           // Texels copied from neighbours, for seamless filtering
+    static constexpr int kTileThreshold = 4096; // Images with a larger edge are tiled
+    static constexpr uint64_t kEvictFrames = 120;
+
+    struct Tile {
+        int px = 0, py = 0, w = 0, h = 0;  // Content rect in level pixels
+        CompressedImage image;             // Content plus border, single level
+        GlTexture texture;
+        uint64_t last_used = 0;            // Frame the tile was last drawn or wanted
+        bool wanted = false;               // Asked for since the last stream()
+    };
+
+    struct Level {
+        int width = 0, height = 0;
+        int tiles_x = 0, tiles_y = 0;
+        std::vector<Tile> tiles;
+        Tile& tile(int tx, int ty) { return tiles[ty * tiles_x + tx]; }
+    };
+
+    int width = 0, height = 0;
+    BlockFormat format = BlockFormat::RGBA8;
+    std::vector<Level> levels;  // levels[0] is full size; the last is one tile
+    uint64_t frame = 0;
+    int last_level = -1;        // Level the last draw used, for the UI
+    int resident_tiles = 0;
+    size_t resident_bytes = 0;
+    uint64_t tile_uploads = 0;
+    uint64_t evictions = 0;
+
+    static bool wants_tiling(int w, int h) { return std::max(w, h) > kTileThreshold; }
+
+    // Pool thread: box-filtered levels down to one tile, each cut into bordered tiles
+    static std::unique_ptr<TiledImage> build(const uint8_t* rgba, int w, int h, BlockFormat format) {
+        auto image = std::make_unique<TiledImage>();
+        image->width = w;
+        image->height = h;
+        image->format = format;
+
+        std::vector<uint8_t> level_pixels, next_pixels, tile_pixels;
+        const uint8_t* src = rgba;
+        int lw = w, lh = h;
+        while (true) {
+            Level level;
+            level.width = lw;
+            level.height = lh;
+            level.tiles_x = (lw + kTileSize - 1) / kTileSize;
+            level.tiles_y = (lh + kTileSize - 1) / kTileSize;
+            for (int ty = 0; ty < level.tiles_y; ++ty) {
+                for (int tx = 0; tx < level.tiles_x; ++tx) {
+                    Tile tile;
+                    tile.px = tx * kTileSize;
+                    tile.py = ty * kTileSize;
+                    tile.w = std::min(kTileSize, lw - tile.px);
+                    tile.h = std::min(kTileSize, lh - tile.py);
+                    int tex_w = tile.w + 2 * kBorder, tex_h = tile.h + 2 * kBorder;
+                    tile_pixels.resize((size_t)tex_w * tex_h * 4);
+                    for (int y = 0; y < tex_h; ++y) {
+                        int sy = std::clamp(tile.py + y - kBorder, 0, lh - 1);
+                        for (int x = 0; x < tex_w; ++x) {
+                            int sx = std::clamp(tile.px + x - kBorder, 0, lw - 1);
+                            memcpy(&tile_pixels[((size_t)y * tex_w + x) * 4], src + ((size_t)sy * lw + sx) * 4, 4);
+                        }
+                    }
+                    tile.image = compress_rgba(tile_pixels.data(), tex_w, tex_h, format, false);
+                    level.tiles.push_back(std::move(tile));
+                }
+            }
+            image->levels.push_back(std::move(level));
+            if (lw <= kTileSize && lh <= kTileSize) break;
+
+            int nw, nh;
+            downsample_rgba(src, lw, lh, next_pixels, nw, nh);
+            level_pixels.swap(next_pixels);
+            src = level_pixels.data();
+            lw = nw;
+            lh = nh;
+        }
+        return image;
+    }
+
+    // Level for `screen_w` x `screen_h` pixels: the finest one drawn at no more
+    // than 1:1 (tiles have a single GL_LINEAR level, so any minification would
+    // alias), or the coarsest when even that is too big
+    int level_for(float screen_w, float screen_h) const {
+        float ratio = std::max(width / std::max(screen_w, 1.0f), height / std::max(screen_h, 1.0f));
+        int level = ratio > 1.0f ? (int)std::ceil(std::log2(ratio) - 1e-4f) : 0;
+        return std::clamp(level, 0, (int)levels.size() - 1);
+    }
+
+    Level& top() { return levels.back(); }
+    const Level& top() const { return levels.back(); }
+
+    // Texture coordinates of a rect of the image (0-1, level independent) inside `tile`
+    void tile_tex_rect(const Level& level, const Tile& tile, const float image_rect[4], float out[4]) const {
+        const CompressedImage& im = tile.image;
+        out[0] = (kBorder + image_rect[0] * level.width - tile.px) / im.width;
+        out[1] = (kBorder + image_rect[1] * level.height - tile.py) / im.height;
+        out[2] = (kBorder + image_rect[2] * level.width - tile.px) / im.width;
+        out[3] = (kBorder + image_rect[3] * level.height - tile.py) / im.height;
+    }
+
+    // Tile of `level_idx` covering the image point (s, t), both 0-1
+    Tile& tile_at(int level_idx, float s, float t) {
+        Level& level = levels[level_idx];
+        int tx = std::clamp((int)(s * level.width) / kTileSize, 0, level.tiles_x - 1);
+        int ty = std::clamp((int)(t * level.height) / kTileSize, 0, level.tiles_y - 1);
+        return level.tile(tx, ty);
+    }
+
+    // Expects GL_UNPACK_ALIGNMENT 1 (tile rows are tightly packed)
+    void upload_tile(Tile& tile) {
+        const CompressedImage& im = tile.image;
+        glBindTexture(GL_TEXTURE_2D, tile.texture.create());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        if (im.format == BlockFormat::RGBA8) {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, im.width, im.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, im.data.data());
+        } else {
+            glCompressedTexImage2D(GL_TEXTURE_2D, 0, block_format_gl(im.format), im.width, im.height, 0,
+                                   (GLsizei)im.data.size(), im.data.data());
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        resident_tiles++;
+        resident_bytes += im.data.size();
+        tile_uploads++;
+    }
+
+    void evict_tile(Tile& tile) {
+        tile.texture.reset();
+        resident_tiles--;
+        resident_bytes -= tile.image.data.size();
+        evictions++;
+    }
+
+    // Makes the top level resident; returns bytes uploaded
+    size_t upload_top() {
+        size_t bytes = 0;
+        for (Tile& tile : top().tiles) {
+            if (!tile.texture) {
+                upload_tile(tile);
+                bytes += tile.image.data.size();
+            }
+        }
+        return bytes;
+    }
+
+    // Render thread, once per frame: uploads tiles the last draws wanted, coarse
+    // levels first, within the budget; evicts tiles unused for kEvictFrames.
+    // Returns bytes uploaded.
+    size_t stream(size_t budget_bytes, float budget_ms, std::chrono::steady_clock::time_point t0) {
+        frame++;
+        size_t sent = 0;
+        for (int l = (int)levels.size() - 1; l >= 0; --l) {
+            for (Tile& tile : levels[l].tiles) {
+                bool pinned = l == (int)levels.size() - 1;
+                if (tile.wanted && !tile.texture && sent < budget_bytes &&
+                    std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t0).count() < budget_ms) {
+                    upload_tile(tile);
+                    sent += tile.image.data.size();
+                }
+                tile.wanted = false;
+                if (tile.texture && !pinned && tile.last_used + kEvictFrames < frame) evict_tile(tile);
+            }
+        }
+        return sent;
+    }
+};
+
+// Phase 29: Handle into a SlotMap: a slot index and the generation it was
+// issued for. Slots start at generation 1, so a default handle is null.
+struct SlotHandle {
+    uint32_t index = 0;
+    uint32_t generation = 0;
+
+    explicit operator bool() const { return generation != 0; }
+    bool operator==(const SlotHandle& other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const SlotHandle& other) const { return !(*this == other); }
+};
+
+// Phase 29: Values addressed by generational handles. Lookup is an index and a
+// generation compare; erasing bumps the slot's generation, so handles to the
+// old value stop resolving instead of aliasing whatever reuses the slot.
+// Values live in their own allocation and never move while in the map.
+template <typename T>
+class SlotMap {
+public:
+    template <typename... Args>
+    SlotHandle insert(Args&&... args) {
+        uint32_t index;
+        if (!free_slots.empty()) {
+            index = free_slots.back();
+            free_slots.pop_back();
+        } else {
+            index = (uint32_t)slots.size();
+            slots.emplace_back();
+        }
+        Slot& slot = slots[index];
+        slot.value = std::make_unique<T>(std::forward<Args>(args)...);
+        count++;
+        return {index, slot.generation};
+    }
+
+    T* get(SlotHandle handle) const {
+        if (handle.index >= slots.size()) return nullptr;
+        const Slot& slot = slots[handle.index];
+        return slot.generation == handle.generation ? slot.value.get() : nullptr;
+    }
+
+    bool erase(SlotHandle handle) {
+        if (!get(handle)) return false;
+        Slot& slot = slots[handle.index];
+        slot.value.reset();
+        slot.generation = slot.generation + 1 ? slot.generation + 1 : 1;
+        free_slots.push_back(handle.index);
+        count--;
+        return true;
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    // f(SlotHandle, T&) for every live value, in slot order
+    template <typename F>
+    void for_each(F&& f) const {
+        for (uint32_t i = 0; i < slots.size(); ++i) {
+            if (slots[i].value) f(SlotHandle{i, slots[i].generation}, *slots[i].value);
+        }
+    }
+
+private:
+    struct Slot {
+        std::unique_ptr<T> value;
+        uint32_t generation = 1;
+    };
+    std::vector<Slot> slots;
+    std::vector<uint32_t> free_slots;
+    size_t count = 0;
+};
+
+using TextureHandle = SlotHandle;
+
+// Phase 24: Where an imported still is on its way to the GPU
+// Phase 28: Evicted assets keep their CPU copy and re-upload when drawn again
+enum class AssetState { Queued, Decoding, Uploading, Ready, Failed, Evicted };
+
+inline const char* asset_state_name(AssetState state) {
+    switch (state) {
+        case AssetState::Queued: return "queued";
+        case AssetState::Decoding: return "decoding";
+        case AssetState::Uploading: return "uploading";
+        case AssetState::Ready: return "ready";
+        case AssetState::Evicted: return "evicted";
+        default: return "failed";
+    }
+}
+
+// Phase 4: Texture/Media management structure
+// Phase 24: filled in asynchronously by ImageImporter; only drawn once ready()
+// Phase 29: lives in MediaLibrary's slot map and is never copied or moved;
+// the importer and atlas keep pointers to it
+struct TextureAsset {
+    GlTexture gl_texture;
+    int width = 0, height = 0;
+    int channels = 0;
+    char filepath[256] = {};
+    std::atomic<AssetState> state{AssetState::Queued};
+    CompressedImage staged;           // Phase 25: levels waiting for upload (importer only)
+    int upload_level = 0;
+    int uploaded_rows = 0;            // Block rows (pixel rows for RGBA8) of upload_level done
+    size_t uploaded_bytes = 0;
+    BlockFormat format = BlockFormat::RGBA8;  // Phase 25: format on the GPU
+    int mip_levels = 0;
+    size_t gpu_bytes = 0;
+    uint64_t content_hash = 0;        // Phase 25: FNV-1a of the file
+    bool from_cache = false;          // Phase 25: loaded from the compressed cache, no encode
+    std::unique_ptr<TiledImage> tiled;  // Phase 26: set instead of gl_texture for very large stills
+    std::vector<uint8_t> atlas_pixels;  // Phase 27: RGBA waiting to be packed (small stills)
+    GLuint atlas_texture = 0;           // Phase 27: shared atlas page, owned by the TextureAtlas
+    float atlas_uv[4] = {0.0f, 0.0f, 1.0f, 1.0f};  // Phase 27: sub-rectangle within it, min.xy max.zw
+    uint64_t last_rendered = 0;       // Phase 28: residency frame this asset was last drawn in
+    int evictions = 0;
+    TextureHandle handle;             // Phase 29: this asset's own handle
+    TextureHandle source;             // Phase 29: same content already imported; drawn from there instead (render thread)
+    TextureHandle duplicate_of;       // Phase 29: found by the pool thread; upload() publishes it as `source`
+    
+    TextureAsset() = default;
+    TextureAsset(const TextureAsset&) = delete;
+    TextureAsset& operator=(const TextureAsset&) = delete;
+
+    std::string name() const { return std::filesystem::path(filepath).filename().string(); }
+
+    bool ready() const { return state == AssetState::Ready && (gl_texture || tiled || atlas_texture); }
+
+    // Whole image in one texture, for previews; the coarsest tile when tiled, the
+    // atlas page (sampled at atlas_uv) when packed
+    GLuint preview_texture() const {
+        if (tiled) return tiled->top().tiles[0].texture.get();
+        return atlas_texture ? atlas_texture : gl_texture.get();
+    }
+    bool importing() const {
+        return state != AssetState::Ready && state != AssetState::Failed && state != AssetState::Evicted;
+    }
+    // width/height are written by the pool thread before it publishes Uploading
+    // (release); read them only once this returns true (acquire)
+    bool size_known() const {
+        AssetState s = state.load(std::memory_order_acquire);
+        return s == AssetState::Uploading || s == AssetState::Ready || s == AssetState::Evicted;
+    }
+
+    // Phase 28: GPU memory held now, and held before eviction
+    size_t resident_bytes() const {
+        if (tiled) return tiled->resident_bytes;
+        return gl_texture || atlas_texture ? gpu_bytes : 0;
+    }
+    size_t evicted_bytes() const { return state == AssetState::Evicted ? gpu_bytes : 0; }
+    float upload_progress() const { return staged.data.empty() ? 0.0f : (float)uploaded_bytes / staged.data.size(); }
+};
+
+// Phase 25: Compressed stills on disk, one file per content hash and alpha
+// format (BC7, or BC3 where BPTC is missing), so an encoding made for one
+// driver never shadows the better one another driver could use
+struct TextureCache {
+    std::string directory = ".vlxcache";
+
+    std::string path_for(uint64_t content_hash, BlockFormat alpha_format) const {
+        char name[40];
+        snprintf(name, sizeof(name), "%016llx.%s.vlxtex", (unsigned long long)content_hash, block_format_name(alpha_format));
+        return (std::filesystem::path(directory) / name).string();
+    }
+
+    bool load(uint64_t content_hash, BlockFormat alpha_format, CompressedImage& image) const {
+        return image.load(path_for(content_hash, alpha_format), content_hash);
+    }
+
+    // Written under a temporary name and renamed, so a reader never sees half a file
+    bool store(uint64_t content_hash, BlockFormat alpha_format, const CompressedImage& image) const {
+        static std::atomic<uint32_t> temp_counter{0};
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+        std::string path = path_for(content_hash, alpha_format);
+        std::string temp = path + ".tmp" + std::to_string(temp_counter++);
+        if (!image.save(temp, content_hash)) {
+            std::filesystem::remove(temp, ec);
+            return false;
+        }
+        std::filesystem::rename(temp, path, ec);
+        return !ec;
+    }
+};
+
+inline bool read_file_bytes(const char* path, std::vector<uint8_t>& bytes) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) return false;
+    bytes.resize((size_t)in.tellg());
+    in.seekg(0);
+    in.read((char*)bytes.data(), bytes.size());
+    return (bool)in;
+}
+
+// Stills stb_image can import, by extension
+inline bool is_image_file(const std::filesystem::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    return ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".tga" || ext == ".bmp";
+}
+
+// Phase 25: Format for a still: BC1 when opaque, BC7 (or BC3 without BPTC) with alpha
+inline BlockFormat choose_block_format(const uint8_t* rgba, int width, int height, bool bc7) {
+    if (!rgba_has_alpha(rgba, (size_t)width * height)) return BlockFormat::BC1;
+    return bc7 ? BlockFormat::BC7 : BlockFormat::BC3;
+}
+
+// Phase 27: Small stills packed into shared RGBA8 pages on shelves, so many
+// icons or sprites sample from a handful of textures. Each entry sits in a
+// cell aligned to kPadding with its edge texels repeated into the padding;
+// mips stop at the level where one texel of padding is left, so no level ever
+// filters across a neighbour. Packing only appends: adding an asset touches
+// one cell and regenerates that page's mips.
+class TextureAtlas {
+public:
+    static constexpr int kPageSize = 2048;
+    static constexpr int kPadding = 8;    // Texels around each entry, and cell alignment
+    static constexpr int kMipLevels = 4;  // kPadding >> (kMipLevels - 1) == 1
+
+    struct Page {
+        GlTexture texture;
+        struct Shelf { int y = 0, height = 0, x = 0; };
+        std::vector<Shelf> shelves;
+        int next_y = 0;       // Top of the next shelf
+        size_t used_texels = 0;
+        bool dirty = false;   // Mips need regenerating
+    };
+
+    std::vector<Page> pages;
+    int entries = 0;
+
+    static bool fits(int w, int h, int max_size) {
+        return max_size > 0 && w <= max_size && h <= max_size && w + 2 * kPadding <= kPageSize && h + 2 * kPadding <= kPageSize;
+    }
+
+    // Render thread: packs the asset's pixels and points it at its sub-rectangle
+    bool insert(TextureAsset& asset) {
+        int cell_w = align(asset.width + 2 * kPadding), cell_h = align(asset.height + 2 * kPadding);
+        int page_idx, x, y;
+        if (!place(cell_w, cell_h, page_idx, x, y)) return false;
+        Page& page = pages[page_idx];
+
+        // Edge-extend into the padding
+        cell.resize((size_t)cell_w * cell_h * 4);
+        for (int cy = 0; cy < cell_h; ++cy) {
+            int sy = std::clamp(cy - kPadding, 0, asset.height - 1);
+            for (int cx = 0; cx < cell_w; ++cx) {
+                int sx = std::clamp(cx - kPadding, 0, asset.width - 1);
+                memcpy(&cell[((size_t)cy * cell_w + cx) * 4], &asset.atlas_pixels[((size_t)sy * asset.width + sx) * 4], 4);
+            }
+        }
+        glBindTexture(GL_TEXTURE_2D, page.texture.get());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, cell_w, cell_h, GL_RGBA, GL_UNSIGNED_BYTE, cell.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        page.used_texels += (size_t)cell_w * cell_h;
+        page.dirty = true;
+
+        asset.atlas_texture = page.texture.get();
+        asset.atlas_uv[0] = (float)(x + kPadding) / kPageSize;
+        asset.atlas_uv[1] = (float)(y + kPadding) / kPageSize;
+        asset.atlas_uv[2] = (float)(x + kPadding + asset.width) / kPageSize;
+        asset.atlas_uv[3] = (float)(y + kPadding + asset.height) / kPageSize;
+        asset.format = BlockFormat::RGBA8;
+        asset.mip_levels = kMipLevels;
+        asset.gpu_bytes = (size_t)cell_w * cell_h * 4;
+        asset.atlas_pixels = std::vector<uint8_t>();
+        entries++;
+        return true;
+    }
+
+    // The asset's cell is left as dead space; packing never moves other entries
+    void remove(TextureAsset& asset) {
+        if (!asset.atlas_texture) return;
+        asset.atlas_texture = 0;
+        reset_uv(asset);  // Whatever it is drawn from next is a whole texture
+        entries--;
+    }
+
+    static void reset_uv(TextureAsset& asset) {
+        asset.atlas_uv[0] = asset.atlas_uv[1] = 0.0f;
+        asset.atlas_uv[2] = asset.atlas_uv[3] = 1.0f;
+    }
+
+    // Render thread, after a frame's inserts
+    void update_mips() {
+        for (Page& page : pages) {
+            if (!page.dirty) continue;
+            glBindTexture(GL_TEXTURE_2D, page.texture.get());
+            glGenerateMipmap(GL_TEXTURE_2D);
+            page.dirty = false;
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Phase 28: GPU memory of every page with its mips, however full
+    size_t resident_bytes() const {
+        size_t page_bytes = 0;
+        for (int l = 0; l < kMipLevels; ++l) page_bytes += (size_t)(kPageSize >> l) * (kPageSize >> l) * 4;
+        return pages.size() * page_bytes;
+    }
+
+    float occupancy() const {
+        size_t used = 0;
+        for (const Page& page : pages) used += page.used_texels;
+        return pages.empty() ? 0.0f : (float)used / ((float)pages.size() * kPageSize * kPageSize);
+    }
+
+private:
+    static int align(int v) { return (v + kPadding - 1) / kPadding * kPadding; }
+
+    // First shelf on any page that is tall enough without wasting more than half
+    // its height, else a new shelf, else a new page
+    bool place(int cell_w, int cell_h, int& page_idx, int& x, int& y) {
+        for (size_t p = 0; p < pages.size(); ++p) {
+            Page& page = pages[p];
+            for (Page::Shelf& shelf : page.shelves) {
+                if (shelf.height >= cell_h && shelf.height <= cell_h * 2 && shelf.x + cell_w <= kPageSize) {
+                    page_idx = (int)p;
+                    x = shelf.x;
+                    y = shelf.y;
+                    shelf.x += cell_w;
+                    return true;
+                }
+            }
+            if (page.next_y + cell_h <= kPageSize) {
+                page.shelves.push_back({page.next_y, cell_h, cell_w});
+                page_idx = (int)p;
+                x = 0;
+                y = page.next_y;
+                page.next_y += cell_h;
+                return true;
+            }
+        }
+        if (!add_page()) return false;
+        Page& page = pages.back();
+        page.shelves.push_back({0, cell_h, cell_w});
+        page.next_y = cell_h;
+        page_idx = (int)pages.size() - 1;
+        x = y = 0;
+        return true;
+    }
+
+    bool add_page() {
+        Page page;
+        if (!page.texture.create()) {
+            std::cerr << "Failed to create atlas page\n";
+            return false;
+        }
+        glBindTexture(GL_TEXTURE_2D, page.texture.get());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, kMipLevels - 1);
+        std::vector<uint8_t> clear((size_t)kPageSize * kPageSize * 4, 0);  // Transparent, including mips
+        for (int l = 0; l < kMipLevels; ++l) {
+            glTexImage2D(GL_TEXTURE_2D, l, GL_RGBA8, kPageSize >> l, kPageSize >> l, 0, GL_RGBA, GL_UNSIGNED_BYTE, clear.data());
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        pages.push_back(std::move(page));
+        return true;
+    }
+
+    std::vector<uint8_t> cell;  // Padded staging for one insert
+};
+
+// Phase 24: Imports stills without stalling the render loop. Files are decoded
+// by tasks on the decoder pool; the render thread uploads the results a strip
+// of rows at a time and stops each frame once its byte or time budget is spent.
+// Phase 25: with compression on, the decode step becomes a cache lookup (or an
+// encode on a miss) and the upload is of compressed blocks with mips.
+class ImageImporter {
+public:
+    static constexpr int kDecodeTasks = 2;
+    static constexpr size_t kStripBytes = 1 << 20;  // Upload granularity between budget checks
+
+    int budget_kb = 8192;       // Upload bytes per frame
+    float budget_ms = 2.0f;     // Upload CPU time per frame
+    size_t last_bytes = 0;      // Uploaded during the last frame
+    float last_ms = 0.0f;
+
+    // Phase 25: compressed texture cache
+    std::atomic<bool> compress{true};  // Set by the UI, read by the decode tasks
+    TextureCache cache;
+    std::atomic<uint32_t> cache_hits{0};
+    std::atomic<uint32_t> encoded{0};
+    bool formats_queried = false;  // Driver support, checked on the first import
+    bool s3tc_supported = false;
+    bool bptc_supported = false;
+
+    // Phase 27: stills no larger than this go to the library's atlas (0 = never)
+    std::atomic<int> atlas_max_size{256};
+    std::vector<TextureAsset*> atlas_ready;  // Decoded, waiting for the library to pack them
+
+    ~ImageImporter() { stop(); }
+
+    // Render thread. Decoding starts on the pool; the asset stays in the library meanwhile.
+    void enqueue(TextureAsset& asset, DecoderPool& decode_pool) {
+        forget(asset);
+        asset.gl_texture.reset();
+        asset.tiled.reset();
+        asset.atlas_pixels.clear();
+        TextureAtlas::reset_uv(asset);  // Phase 27: it may not go to the atlas this time
+        asset.source = TextureHandle();
+        asset.duplicate_of = TextureHandle();
+        asset.state = AssetState::Queued;
+        if (!pool) {
+            query_formats();
+            pool = &decode_pool;
+            for (int i = 0; i < kDecodeTasks; ++i) {
+                workers.push_back(std::make_unique<Worker>());
+                workers.back()->importer = this;
+                pool->add(workers.back().get());
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        queued.push_back(&asset);
+    }
+
+    // Render thread: drops every reference the importer keeps to a finished
+    // (not importing) asset, before it is re-queued or destroyed
+    void forget(TextureAsset& asset) {
+        tiled_assets.erase(std::remove(tiled_assets.begin(), tiled_assets.end(), &asset), tiled_assets.end());
+        atlas_ready.erase(std::remove(atlas_ready.begin(), atlas_ready.end(), &asset), atlas_ready.end());
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = by_hash.find(asset.content_hash);
+        if (it != by_hash.end() && it->second == &asset) by_hash.erase(it);
+    }
+
+    // Phase 29: Render thread. A duplicate waiting to publish `duplicate_of` is
+    // imported on its own instead, for when that original is being removed.
+    void requeue_duplicate(TextureAsset& asset) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = std::find(decoded.begin(), decoded.end(), &asset);
+            if (it == decoded.end()) return;
+            decoded.erase(it);
+        }
+        enqueue(asset, *pool);
+    }
+
+    // Phase 28: re-uploads an evicted asset from its staged copy, within the usual budget
+    void restore(TextureAsset& asset) {
+        asset.state = AssetState::Uploading;
+        std::lock_guard<std::mutex> lock(mutex);
+        decoded.push_back(&asset);
+    }
+
+    void stop() {
+        if (!pool) return;
+        for (auto& worker : workers) pool->remove(worker.get());
+        workers.clear();
+        pool = nullptr;
+    }
+
+    // Assets not yet ready, decoding or uploading
+    size_t pending() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return queued.size() + decoding + decoded.size();
+    }
+
+    // Render thread, once per frame. `textures` resolves duplicates' originals.
+    void upload(const SlotMap<TextureAsset>& textures) {
+        auto t0 = std::chrono::steady_clock::now();
+        size_t budget = (size_t)std::max(1, budget_kb) << 10;
+        size_t sent = 0;
+        float ms = 0.0f;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        while (sent < budget && ms < budget_ms) {
+            TextureAsset* asset = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (decoded.empty()) break;
+                asset = decoded.front();
+            }
+            // Phase 29: a duplicate of another asset's content has nothing to upload.
+            // `source` is only ever written here, on the thread that reads it.
+            if (asset->duplicate_of) {
+                // Original removed since the pool thread matched it: import this one instead
+                if (!textures.get(asset->duplicate_of)) {
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        decoded.pop_front();
+                    }
+                    enqueue(*asset, *pool);
+                    continue;
+                }
+                asset->source = asset->duplicate_of;
+                asset->state = AssetState::Ready;
+                std::lock_guard<std::mutex> lock(mutex);
+                decoded.pop_front();
+                continue;
+            }
+
+            // Phase 27: small stills are packed by the library instead
+            if (!asset->atlas_pixels.empty()) {
+                atlas_ready.push_back(asset);
+                std::lock_guard<std::mutex> lock(mutex);
+                decoded.pop_front();
+                continue;
+            }
+
+            // Phase 26: tiled stills only need their coarsest level to be drawable
+            if (asset->tiled) {
+                sent += asset->tiled->upload_top();
+                asset->format = asset->tiled->format;
+                asset->mip_levels = (int)asset->tiled->levels.size();
+                asset->state = AssetState::Ready;
+                tiled_assets.push_back(asset);
+                std::lock_guard<std::mutex> lock(mutex);
+                decoded.pop_front();
+                std::cout << "Loaded tiled texture: " << asset->filepath << " (" << asset->width << "x" << asset->height
+                          << ", " << asset->mip_levels << " levels, " << block_format_name(asset->format) << ")\n";
+                ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t0).count();
+                continue;
+            }
+
+            CompressedImage& image = asset->staged;
+            if (!asset->gl_texture) allocate(*asset);
+
+            // At least one row per call, so any budget makes progress
+            const CompressedImage::Level& level = image.levels[asset->upload_level];
+            size_t row_bytes;
+            int level_rows;
+            block_rows(image.format, level.width, level.height, row_bytes, level_rows);
+            int rows = std::clamp((int)(std::min(budget - sent, kStripBytes) / row_bytes), 1,
+                                  level_rows - asset->uploaded_rows);
+            const uint8_t* src = image.data.data() + level.offset + asset->uploaded_rows * row_bytes;
+            glBindTexture(GL_TEXTURE_2D, asset->gl_texture.get());
+            if (image.format == BlockFormat::RGBA8) {
+                glTexSubImage2D(GL_TEXTURE_2D, asset->upload_level, 0, asset->uploaded_rows, level.width, rows,
+                                GL_RGBA, GL_UNSIGNED_BYTE, src);
+            } else {
+                // Whole block rows; the last one may be cut short by the level's edge
+                int y = asset->uploaded_rows * 4;
+                glCompressedTexSubImage2D(GL_TEXTURE_2D, asset->upload_level, 0, y, level.width,
+                                          std::min(rows * 4, level.height - y), block_format_gl(image.format),
+                                          (GLsizei)(rows * row_bytes), src);
+            }
+            asset->uploaded_rows += rows;
+            asset->uploaded_bytes += rows * row_bytes;
+            sent += rows * row_bytes;
+            if (asset->uploaded_rows == level_rows) {
+                asset->upload_level++;
+                asset->uploaded_rows = 0;
+            }
+
+            if (asset->upload_level == (int)image.levels.size()) {
+                asset->format = image.format;
+                asset->mip_levels = (int)image.levels.size();
+                asset->gpu_bytes = image.data.size();
+                asset->state = AssetState::Ready;  // Phase 28: staged stays, for re-upload after eviction
+                std::lock_guard<std::mutex> lock(mutex);
+                decoded.pop_front();
+                std::cout << (asset->evictions ? "Restored texture: " : "Loaded texture: ") << asset->filepath << " (" << asset->width << "x" << asset->height
+                          << ", " << block_format_name(asset->format) << ")\n";
+            }
+            ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        }
+
+        // Phase 26: tiles last frame's draws asked for share what's left of the budget
+        for (TextureAsset* asset : tiled_assets) {
+            sent += asset->tiled->stream(sent < budget ? budget - sent : 0, budget_ms, t0);
+        }
+        ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        last_bytes = sent;
+        last_ms = ms;
+    }
+
+private:
+    struct Worker : DecodeTask {
+        ImageImporter* importer = nullptr;
+        bool step() override { return importer->decode_next(); }
+    };
+
+    void query_formats() {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &count);
+        std::vector<GLint> formats(std::max(0, count));
+        if (count > 0) glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, formats.data());
+        for (GLint f : formats) {
+            if (f == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) s3tc_supported = true;
+            if (f == GL_COMPRESSED_RGBA_BPTC_UNORM) bptc_supported = true;
+        }
+        s3tc_supported = s3tc_supported || GLAD_GL_EXT_texture_compression_s3tc;  // Some drivers don't list it
+        bptc_supported = bptc_supported || GLAD_GL_VERSION_4_2;  // Core since 4.2 even if not listed
+        formats_queried = true;
+    }
+
+    bool format_supported(BlockFormat format) const {
+        if (format == BlockFormat::BC7) return bptc_supported;
+        return format == BlockFormat::RGBA8 || s3tc_supported;
+    }
+
+    // Texture storage for every level, filled in by upload()
+    void allocate(TextureAsset& asset) {
+        const CompressedImage& image = asset.staged;
+        glBindTexture(GL_TEXTURE_2D, asset.gl_texture.create());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, image.levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1);
+        for (size_t l = 0; l < image.levels.size(); ++l) {
+            const CompressedImage::Level& level = image.levels[l];
+            if (image.format == BlockFormat::RGBA8) {
+                glTexImage2D(GL_TEXTURE_2D, (GLint)l, GL_RGBA8, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            } else {
+                glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)l, block_format_gl(image.format), level.width, level.height, 0,
+                                       (GLsizei)level.size, nullptr);
+            }
+        }
+        asset.upload_level = 0;
+        asset.uploaded_rows = 0;
+        asset.uploaded_bytes = 0;
+    }
+
+    // Pool thread: turns one queued file into upload-ready levels and hands it to upload()
+    bool decode_next() {
+        TextureAsset* asset = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (queued.empty()) return false;
+            asset = queued.front();
+            queued.pop_front();
+            decoding++;
+        }
+        asset->state = AssetState::Decoding;
+        bool ok = prepare(*asset);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        decoding--;
+        if (!ok) {
+            // Later imports of the same content must not share a failed asset
+            auto it = by_hash.find(asset->content_hash);
+            if (it != by_hash.end() && it->second == asset) by_hash.erase(it);
+            asset->state = AssetState::Failed;
+            return true;
+        }
+        asset->state.store(AssetState::Uploading, std::memory_order_release);  // Publishes width/height
+        decoded.push_back(asset);
+        return true;
+    }
+
+    bool prepare(TextureAsset& asset) {
+        std::vector<uint8_t> file;
+        if (!read_file_bytes(asset.filepath, file)) {
+            std::cerr << "Failed to load image: " << asset.filepath << "\n";
+            return false;
+        }
+        asset.content_hash = fnv1a64(file.data(), file.size());
+        asset.from_cache = false;
+
+        // Phase 29: content already imported (or importing) under another path is shared
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = by_hash.find(asset.content_hash);
+            if (it != by_hash.end() && it->second != &asset) {
+                asset.duplicate_of = it->second->handle;
+                return true;
+            }
+            by_hash[asset.content_hash] = &asset;
+        }
+        bool use_blocks = compress.load() && s3tc_supported;
+        BlockFormat alpha_format = bptc_supported ? BlockFormat::BC7 : BlockFormat::BC3;
+
+        // Phase 26: very large stills are cut into a tile pyramid instead (not cached)
+        int w = 0, h = 0, c = 0;
+        bool known = stbi_info_from_memory(file.data(), (int)file.size(), &w, &h, &c);
+        bool tile = known && TiledImage::wants_tiling(w, h);
+        bool small = known && !tile && TextureAtlas::fits(w, h, atlas_max_size);  // Phase 27: decoded for the atlas, not cached
+
+        // Phase 25: a cached encoding skips the image decode entirely
+        CompressedImage& image = asset.staged;
+        if (!tile && !small && use_blocks && cache.load(asset.content_hash, alpha_format, image) &&
+            format_supported(image.format)) {
+            asset.width = image.width;
+            asset.height = image.height;
+            asset.channels = 4;
+            asset.from_cache = true;
+            cache_hits++;
+            return true;
+        }
+
+        unsigned char* data = stbi_load_from_memory(file.data(), (int)file.size(), &w, &h, &c, 4);  // Force RGBA
+        if (!data) {
+            std::cerr << "Failed to load image: " << asset.filepath << "\n";
+            return false;
+        }
+        if (small) {
+            asset.atlas_pixels.assign(data, data + (size_t)w * h * 4);
+        } else if (tile) {
+            BlockFormat format = use_blocks ? choose_block_format(data, w, h, bptc_supported) : BlockFormat::RGBA8;
+            asset.tiled = TiledImage::build(data, w, h, format);
+            if (use_blocks) encoded++;
+        } else if (use_blocks) {
+            BlockFormat format = choose_block_format(data, w, h, bptc_supported);
+            image = compress_rgba(data, w, h, format, true);
+            encoded++;
+            if (!cache.store(asset.content_hash, alpha_format, image)) {
+                std::cerr << "Cannot write texture cache: " << cache.path_for(asset.content_hash, alpha_format) << "\n";
+            }
+        } else {
+            image = compress_rgba(data, w, h, BlockFormat::RGBA8, false);
+        }
+        stbi_image_free(data);
+        asset.width = w;
+        asset.height = h;
+        asset.channels = 4;
+        return true;
+    }
+
+    std::mutex mutex;
+    std::deque<TextureAsset*> queued;   // Waiting for a decode task
+    std::deque<TextureAsset*> decoded;  // Waiting for upload, front one possibly part way
+    std::vector<TextureAsset*> tiled_assets;  // Phase 26: ready tiled stills, streamed every frame (render thread)
+    std::unordered_map<uint64_t, TextureAsset*> by_hash;  // Phase 29: first asset imported with each content hash
+    int decoding = 0;
+    DecoderPool* pool = nullptr;
+    std::vector<std::unique_ptr<Worker>> workers;
+};
+
+// Phase 13: Textures a layer samples from. RGBA content uses planes[0] only;
+// YUV content keeps one texture per plane and is converted in the shader.
+struct FrameTextures {
+    GLuint planes[3] = {0, 0, 0};
+    FrameLayout layout = FrameLayout::RGBA;
+    int width = 0, height = 0;
+    int color_matrix = 0;     // 0 = BT.601, 1 = BT.709
+    bool full_range = false;
+    float uv[4] = {0.0f, 0.0f, 1.0f, 1.0f};  // Phase 27: part of planes[0] sampled (atlas entries)
+
+    FrameTextures() = default;
+    explicit FrameTextures(GLuint rgba_texture) { planes[0] = rgba_texture; }
+
+    bool valid() const { return planes[0] != 0; }
+
+    void release() {
+        for (GLuint& t : planes) {
+            if (t) glDeleteTextures(1, &t);
+            t = 0;
+        }
+        width = height = 0;
+    }
+
+    // (Re)creates the plane textures when the layout or size changes
+    void allocate(FrameLayout new_layout, int w, int h) {
+        if (valid() && layout == new_layout && width == w && height == h) return;
+        release();
+        layout = new_layout;
+        width = w;
+        height = h;
+
+        glGenTextures(layout_plane_count(layout), planes);
+        for (int p = 0; p < layout_plane_count(layout); ++p) {
+            int pw, ph, bpp;
+            layout_plane_size(layout, p, w, h, pw, ph, bpp);
+            GLenum internal_format = bpp == 4 ? GL_RGBA8 : bpp == 2 ? GL_RG8 : GL_R8;
+            GLenum format = bpp == 4 ? GL_RGBA : bpp == 2 ? GL_RG : GL_RED;
+
+            glBindTexture(GL_TEXTURE_2D, planes[p]);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            if (layout != FrameLayout::RGBA && p == 0) {
+                // Luma previews as greyscale in the editor; the shader only reads .r
+                GLint swizzle[4] = {GL_RED, GL_RED, GL_RED, GL_ONE};
+                glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+            }
+            if (GLAD_GL_VERSION_4_2) {
+                // Phase 14: immutable storage, allocated once and only ever updated in place
+                glTexStorage2D(GL_TEXTURE_2D, 1, internal_format, pw, ph);
+            } else {
+                glTexImage2D(GL_TEXTURE_2D, 0, internal_format, pw, ph, 0, format, GL_UNSIGNED_BYTE, nullptr);
+            }
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    void upload(const DecodedFrame& f) {
+        allocate(f.layout, f.width, f.height);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (int p = 0; p < layout_plane_count(layout); ++p) {
+            int pw, ph, bpp;
+            layout_plane_size(layout, p, f.width, f.height, pw, ph, bpp);
+            GLenum format = bpp == 4 ? GL_RGBA : bpp == 2 ? GL_RG : GL_RED;
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, f.strides[p] / bpp);
+            glBindTexture(GL_TEXTURE_2D, planes[p]);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, pw, ph, format, GL_UNSIGNED_BYTE, f.planes[p]);
+        }
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+};
+
+// Phase 14: Streams video frames into FrameTextures through a ring of pixel
+// buffer objects. Each PBO is fenced after its glTexSubImage2D, and a PBO whose
+// fence hasn't signalled is never touched, so the CPU never waits on the GPU.
+struct PboUploader {
+    static constexpr int kPboCount = 3;
+
+    GLuint pbos[kPboCount] = {0, 0, 0};
+    GLsync fences[kPboCount] = {nullptr, nullptr, nullptr};
+    size_t pbo_size = 0;
+    int next = 0;
+    bool enabled = true;
+
+    // Stats
+    uint64_t uploads = 0;
+    uint64_t busy_skips = 0;     // Frames held back because the next PBO was still in flight
+    float last_upload_ms = 0.0f; // CPU time spent issuing the last upload
+
+    ~PboUploader() { release(); }
+
+    void release() {
+        for (int i = 0; i < kPboCount; ++i) {
+            if (fences[i]) glDeleteSync(fences[i]);
+            fences[i] = nullptr;
+        }
+        if (pbos[0]) glDeleteBuffers(kPboCount, pbos);
+        for (GLuint& b : pbos) b = 0;
+        pbo_size = 0;
+        next = 0;
+    }
+
+    // True if the next PBO in the ring is free to write without stalling
+    bool ready() {
+        if (!enabled || !fences[next]) return true;
+        GLenum state = glClientWaitSync(fences[next], 0, 0);
+        if (state == GL_ALREADY_SIGNALED || state == GL_CONDITION_SATISFIED) {
+            glDeleteSync(fences[next]);
+            fences[next] = nullptr;
+            return true;
+        }
+        return false;
+    }
+
+    void upload(FrameTextures& target, const DecodedFrame& f) {
+        auto t0 = std::chrono::steady_clock::now();
+        if (!enabled) {
+            target.upload(f);
+        } else {
+            upload_through_pbo(target, f);
+        }
+        last_upload_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        uploads++;
+    }
+
+    // Phase 15: The frame already sits in a persistently mapped buffer; point the
+    // texture upload at it directly and return the fence guarding the slot
+    GLsync upload_mapped(FrameTextures& target, const DecodedFrame& f, GLuint buffer, const uint8_t* base) {
+        auto t0 = std::chrono::steady_clock::now();
+        target.allocate(f.layout, f.width, f.height);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (int p = 0; p < layout_plane_count(f.layout); ++p) {
+            int pw, ph, bpp;
+            layout_plane_size(f.layout, p, f.width, f.height, pw, ph, bpp);
+            GLenum format = bpp == 4 ? GL_RGBA : bpp == 2 ? GL_RG : GL_RED;
+            glBindTexture(GL_TEXTURE_2D, target.planes[p]);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, pw, ph, format, GL_UNSIGNED_BYTE,
+                            (const void*)(uintptr_t)(f.planes[p] - base));
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        last_upload_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        uploads++;
+        return fence;
+    }
+
+private:
+    void upload_through_pbo(FrameTextures& target, const DecodedFrame& f) {
+        target.allocate(f.layout, f.width, f.height);
+        size_t bytes = layout_frame_bytes(f.layout, f.width, f.height);
+        if (bytes > pbo_size) {
+            release();
+            glGenBuffers(kPboCount, pbos);
+            for (GLuint b : pbos) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, b);
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+            }
+            pbo_size = bytes;
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[next]);
+        // The fence guarantees the GPU is done with this PBO, so skip driver synchronisation
+        uint8_t* dst = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+                                                  GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (!dst) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            target.upload(f);
+            return;
+        }
+
+        // Pack the planes tightly, dropping any decoder row padding
+        size_t offsets[3] = {0, 0, 0};
+        size_t offset = 0;
+        for (int p = 0; p < layout_plane_count(f.layout); ++p) {
+            int pw, ph, bpp;
+            layout_plane_size(f.layout, p, f.width, f.height, pw, ph, bpp);
+            size_t row_bytes = (size_t)pw * bpp;
+            offsets[p] = offset;
+            if (f.strides[p] == (int)row_bytes) {
+                memcpy(dst + offset, f.planes[p], row_bytes * ph);
+            } else {
+                for (int y = 0; y < ph; ++y) {
+                    memcpy(dst + offset + y * row_bytes, f.planes[p] + (size_t)y * f.strides[p], row_bytes);
+                }
+            }
+            offset += row_bytes * ph;
+        }
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (int p = 0; p < layout_plane_count(f.layout); ++p) {
+            int pw, ph, bpp;
+            layout_plane_size(f.layout, p, f.width, f.height, pw, ph, bpp);
+            GLenum format = bpp == 4 ? GL_RGBA : bpp == 2 ? GL_RG : GL_RED;
+            glBindTexture(GL_TEXTURE_2D, target.planes[p]);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, pw, ph, format, GL_UNSIGNED_BYTE, (const void*)(uintptr_t)offsets[p]);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        fences[next] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        next = (next + 1) % kPboCount;
+    }
+};
+
+// Phase 13: Column-major YUV -> RGB matrix and offset for the fragment shader
+inline void yuv_to_rgb_coefficients(int color_matrix, bool full_range, float matrix[9], float offset[3]) {
+    // Kr/Kb-derived coefficients: R = Y + a*Cr, G = Y - b*Cb - c*Cr, B = Y + d*Cb
+    float a = 1.402f, b = 0.344136f, c = 0.714136f, d = 1.772f;  // BT.601
+    if (color_matrix == 1) {
+        a = 1.5748f; b = 0.187324f; c = 0.468124f; d = 1.8556f;  // BT.709
+    }
+    float y_scale = full_range ? 1.0f : 255.0f / 219.0f;
+    float c_scale = full_range ? 1.0f : 255.0f / 224.0f;
+
+    // Columns multiply Y, Cb and Cr respectively
+    float m[9] = {
+        y_scale, y_scale, y_scale,
+        0.0f, -b * c_scale, d * c_scale,
+        a * c_scale, -c * c_scale, 0.0f,
+    };
+    memcpy(matrix, m, sizeof(m));
+    offset[0] = full_range ? 0.0f : 16.0f / 255.0f;
+    offset[1] = 128.0f / 255.0f;
+    offset[2] = 128.0f / 255.0f;
+}
+
+// Phase 16: Library-wide video decode settings, shared by every source
+struct VideoSettings {
+    bool async_decode = true;    // Decode on pool threads instead of the render loop
+    int ring_depth = 4;          // Frames each source may decode ahead
+    bool mapped_decode = false;  // Phase 15: decode straight into persistently mapped staging memory
+    bool yuv_upload = true;      // Phase 13: upload native planes when the pixel format allows it
+    bool pbo_upload = true;      // Phase 14: stream uploads through PBOs
+    int frame_cache_mb = 256;    // Phase 18: decoded-frame cache budget for the preview clip
+    bool keyframe_scrub = true;  // Phase 18: show keyframes while dragging, exact frame on release
+    bool loop_playback = false;  // Phase 19: loop gaplessly between each clip's in and out points
+    bool footprint_scaling = true; // Phase 20: decode no larger than the quads showing a clip
+
+    // Phase 15: Persistent mapping needs buffer storage (GL 4.4)
+    static bool mapped_decode_supported() { return GLAD_GL_VERSION_4_4 != 0; }
+};
+
+// Phase 16: One playing instance of a clip: its decoder, GPU textures and upload
+// state. All sources share the decoder pool.
+// Phase 17: Layers showing the same clip share one source (reference counted);
+// layers trailing it by a short delay read from its frame history.
+struct VideoSource {
+    static constexpr int kHistoryFrames = 8;
+
+    std::string path;
+    VideoDecoder decoder;
+    FrameTextures texture;        // Phase 13: RGBA or per-plane YUV textures
+    PboUploader uploader;         // Phase 14: streaming PBO uploads into texture
+    GLuint mapped_buffer = 0;     // Phase 15: ring storage when decoding into mapped memory
+    uint8_t* mapped_ptr = nullptr;
+    float staging_ms[2] = {0.0f, 0.0f};  // Phase 15: per-frame convert + upload cost, [0]=copy path, [1]=mapped
+    double on_screen_seconds = -1.0;     // PTS of the frame in texture
+    bool loaded = false;
+
+    // Phase 21: suspended while no layer showing it is visible
+    static constexpr double kWarmMaxLagSeconds = 0.1;  // Older warm frames mean the clock jumped
+    bool suspended = false;
+    int visible_consumers = 0;    // Visible layers bound this frame
+    double warm_requested_at = -1.0;
+
+    // Phase 20: output resolution follows the largest quad showing this source
+    static constexpr int kMaxOutputShift = 3;
+    float footprint = 0.0f;       // Largest fraction of the source size needed this frame
+    double shrink_since = -1.0;   // When a smaller output first became enough
+
+    // Phase 18: timeline scrubbing
+    int scrub_frame = -1;         // Frame under the slider while dragging
+    int scrub_keyframe = -1;      // Keyframe last requested while dragging
+    bool scrub_hold = false;      // A cached frame is on screen; leave the ring alone
+    DecodedFrame cached_frame;    // Copy out of the cache, uploaded after its lock is released
+
+    // Phase 17: shared playback
+    double time_offset = 0.0;     // Plays the master clock minus this many seconds
+    double max_delay = 0.0;       // Largest extra delay a sharing layer needs this frame
+    std::vector<FrameTextures> history;  // Previously shown frames, oldest overwritten first
+    std::vector<double> history_seconds; // PTS per history entry (-1 = empty)
+    size_t history_next = 0;
+
+    const VideoSettings* settings;
+    DecoderPool* pool;
+
+    VideoSource(const VideoSettings& video_settings, DecoderPool& decode_pool)
+        : settings(&video_settings), pool(&decode_pool) {}
+
+    ~VideoSource() {
+        stop_decoder();
+        uploader.release();
+        texture.release();
+        set_history_enabled(false);
+    }
+
+    // Phase 17: seconds of past frames a sharing layer may lag behind
+    double history_window() const { return kHistoryFrames * decoder.frame_duration; }
+
+    // True if a layer at `offset` can be served by this source
+    bool can_serve(double offset) const {
+        double delay = offset - time_offset;
+        return delay == 0.0 || (delay > 0.0 && delay <= history_window());
+    }
+
+    // History textures are allocated lazily by the first upload into them
+    void set_history_enabled(bool enabled) {
+        if (enabled == !history.empty()) return;
+        for (FrameTextures& t : history) t.release();
+        history.assign(enabled ? kHistoryFrames : 0, FrameTextures());
+        history_seconds.assign(history.size(), -1.0);
+        history_next = 0;
+    }
+
+    void clear_history() {
+        for (double& seconds : history_seconds) seconds = -1.0;
+    }
+
+    // Moves the frame on screen into the history before a new one is uploaded.
+    // Textures are swapped, not copied: the oldest entry becomes the upload target.
+    void push_history() {
+        if (history.empty() || on_screen_seconds < 0.0) return;
+        FrameTextures& slot = history[history_next];
+        std::swap(texture, slot);
+        texture.color_matrix = slot.color_matrix;
+        texture.full_range = slot.full_range;
+        history_seconds[history_next] = on_screen_seconds;
+        history_next = (history_next + 1) % history.size();
+    }
+
+    // Frame to show for a layer `delay` seconds behind this source
+    const FrameTextures& texture_delayed(double delay) const {
+        if (delay <= 0.0 || history.empty()) return texture;
+        double target = on_screen_seconds - delay + 1e-6;
+        int best = -1, oldest = -1;
+        for (int i = 0; i < (int)history.size(); ++i) {
+            if (history_seconds[i] < 0.0) continue;
+            if (history_seconds[i] <= target && (best < 0 || history_seconds[i] > history_seconds[best])) best = i;
+            if (oldest < 0 || history_seconds[i] < history_seconds[oldest]) oldest = i;
+        }
+        // Until the history has filled up, the oldest frame is the closest we have
+        if (best < 0) best = oldest;
+        return best >= 0 && history[best].valid() ? history[best] : texture;
+    }
+
+    // Bytes held by the decode ring and textures; what a duplicate source would cost
+    size_t memory_bytes() const {
+        size_t frame_bytes = layout_frame_bytes(decoder.output_layout, decoder.width, decoder.height);
+        size_t sequence_bytes = decoder.sequence ? decoder.sequence->buffer_bytes() : 0;  // Phase 23
+        return frame_bytes * (decoder.ring.capacity() + 1 + history.size()) + sequence_bytes;
+    }
+
+    bool open(const std::string& clip_path, int ffmpeg_threads, double start_seconds) {
+        stop_decoder();
+        path = clip_path;
+        loaded = false;
+        decoder.allow_yuv = settings->yuv_upload;
+        if (!decoder.open(clip_path, ffmpeg_threads, pool)) return false;
+        decoder.cache.set_budget(cache_budget());
+        decoder.loop_enabled = settings->loop_playback;
+        // Phase 19: join a looping timeline part way through
+        double source_seconds = decoder.loop_source_seconds(start_seconds, decoder.loop_offset_seconds);
+
+        // Create initial video texture(s) in the decoder's upload layout
+        texture.allocate(decoder.output_layout, decoder.width, decoder.height);
+        texture.color_matrix = decoder.color_matrix;
+        texture.full_range = decoder.full_range;
+
+        if (source_seconds > 0.0) decoder.seek_internal(decoder.frame_at_seconds(source_seconds));
+        decoder.clock_seconds = start_seconds;
+        uploader.enabled = settings->pbo_upload;
+        uploader.release();  // Resized for the new clip on first upload
+        if (settings->async_decode) start_decoder();
+        on_screen_seconds = -1.0;
+        loaded = true;
+        return true;
+    }
+
+    // Starts pool decoding, backing the ring with mapped GL memory if requested
+    void start_decoder() {
+        if (decoder.worker_running) return;
+        release_mapped_buffer();
+
+        if (!settings->mapped_decode || !VideoSettings::mapped_decode_supported()) {
+            decoder.start_async(*pool, settings->ring_depth);
+            return;
+        }
+
+        // Slots are 256-byte aligned so every plane offset is a valid unpack offset
+        size_t slot_bytes = layout_frame_bytes(decoder.output_layout, decoder.width, decoder.height);
+        slot_bytes = (slot_bytes + 255) & ~(size_t)255;
+        size_t total = slot_bytes * settings->ring_depth;
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+        glGenBuffers(1, &mapped_buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mapped_buffer);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, total, nullptr, flags);
+        mapped_ptr = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, total, flags);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (!mapped_ptr) {
+            std::cerr << "Cannot map staging buffer, using the copy path\n";
+            release_mapped_buffer();
+            decoder.start_async(*pool, settings->ring_depth);
+            return;
+        }
+        decoder.start_async(*pool, settings->ring_depth, mapped_ptr, slot_bytes);
+    }
+
+    void stop_decoder() {
+        decoder.stop_async();
+        // Fences of slots the GPU may still be reading
+        for (size_t i = 0; i < decoder.ring.capacity(); ++i) {
+            DecodedFrame& slot = decoder.ring.slot(i);
+            if (slot.upload_fence) glDeleteSync(slot.upload_fence);
+            slot.upload_fence = nullptr;
+        }
+        release_mapped_buffer();
+    }
+
+    void release_mapped_buffer() {
+        if (!mapped_buffer) return;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mapped_buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &mapped_buffer);  // The driver defers deletion until pending reads finish
+        mapped_buffer = 0;
+        mapped_ptr = nullptr;
+    }
+
+    // Re-applies changed VideoSettings, resuming from the frame on screen
+    void apply_settings() {
+        if (!loaded) return;
+        stop_decoder();
+        decoder.allow_yuv = settings->yuv_upload;
+        decoder.choose_output_layout();
+        decoder.cache.clear();  // Cached frames may be in the old layout
+        decoder.cache.set_budget(cache_budget());
+        uploader.release();
+        uploader.enabled = settings->pbo_upload;
+        on_screen_seconds = -1.0;
+        clear_history();
+        // Decoding ran ahead; put the demuxer back on the frame we last showed.
+        // With a worker the seek goes through its handoff, so the render thread
+        // never decodes the GOP itself.
+        int frame_idx = (int)decoder.current_frame.load(std::memory_order_acquire);
+        double loop_offset = decoder.loop_offset_seconds;
+        if (settings->async_decode) {
+            start_decoder();
+            decoder.seek_to_frame(frame_idx, loop_offset);
+        } else {
+            decoder.seek_internal(frame_idx);
         }
-        
-        if (video_stream_idx < 0) {
-            std::cerr << "No video stream found\n";
+    }
+
+    // Phase 21: Stop decoding and uploading; the decoder only keeps a warm frame
+    void suspend() {
+        if (suspended) return;
+        suspended = true;
+        decoder.suspended = true;
+        warm_requested_at = -1.0;
+    }
+
+    // Phase 21: Show the warm frame at once and hand the rest to the worker. While
+    // hidden the worker keeps the warm frame on the show time, so it carries on
+    // from the frame after it without a seek; the render thread never decodes.
+    // Returns whether the texture was uploaded to.
+    bool resume(double master_now) {
+        if (!suspended) return false;
+        suspended = false;
+        warm_requested_at = -1.0;
+        if (!decoder.worker_running) {
+            decoder.suspended = false;
+            seek_seconds(master_now);  // Synchronous decode has no warm state
             return false;
         }
-        
-        // Get codec and open
-        const AVCodec* codec = avcodec_find_decoder(fmt_ctx->streams[video_stream_idx]->codecpar->codec_id);
-        if (!codec) {
-            std::cerr << "Codec not found\n";
-            return false;
+
+        double now = std::max(0.0, master_now - time_offset);
+        double loop_offset = 0.0;
+        int frame_idx = decoder.frame_at_seconds(decoder.loop_source_seconds(now, loop_offset));
+        bool warm_used = false;
+        {
+            std::lock_guard<std::mutex> lock(decoder.warm_mutex);
+            // Same loop iteration and at most a few frames behind the clock
+            if (decoder.warm_index >= 0 && decoder.warm_index <= frame_idx &&
+                decoder.warm.pts_seconds <= now && now - decoder.warm.pts_seconds < kWarmMaxLagSeconds) {
+                push_history();
+                if (uploader.ready()) {
+                    uploader.upload(texture, decoder.warm);
+                } else {
+                    texture.upload(decoder.warm);
+                }
+                on_screen_seconds = decoder.warm.pts_seconds;
+                frame_idx = decoder.warm_index + 1;
+                warm_used = true;
+            }
+            decoder.warm_index = -1;
         }
-        
-        codec_ctx = avcodec_alloc_context3(codec);
-        avcodec_parameters_to_context(codec_ctx, fmt_ctx->streams[video_stream_idx]->codecpar);
-        
-        if (avcodec_open2(codec_ctx, codec, nullptr) < 0) {
-            std::cerr << "Cannot open codec\n";
-            return false;
+        if (!warm_used) {
+            on_screen_seconds = -1.0;
+            clear_history();
         }
-        
-        width = codec_ctx->width;
-        height = codec_ctx->height;
-        
-        // Allocate frames
-        frame = av_frame_alloc();
-        frame_rgb = av_frame_alloc();
-        if (!frame || !frame_rgb) {
-            std::cerr << "Cannot allocate frames\n";
-            return false;
+        // Frames queued before the suspension are stale; the handoff bumps the serial
+        decoder.resume_at_frame(frame_idx, loop_offset);
+        return warm_used;
+    }
+
+    // Phase 20: Called by every consumer each frame with its on-screen size in pixels
+    void add_footprint(float w, float h) {
+        if (!loaded || decoder.src_width <= 0 || decoder.src_height <= 0) return;
+        footprint = std::max(footprint, std::max(w / decoder.src_width, h / decoder.src_height));
+    }
+
+    // Phase 20: Once per frame, after all consumers reported. Picks the smallest
+    // 1/2^n output that still covers the footprint. Growing happens at once;
+    // shrinking needs a 25% margin held for half a second, so dragging a quad
+    // corner across a step doesn't reopen the decoder over and over.
+    void update_output_scale() {
+        float need = footprint;
+        footprint = 0.0f;
+        if (!loaded) return;
+        if (settings->footprint_scaling && need <= 0.0f) return;  // Not on screen this frame; keep what we have
+
+        int shift = 0;
+        if (settings->footprint_scaling) {
+            while (shift < kMaxOutputShift && need <= 1.0f / (2 << shift)) ++shift;
         }
-        
-        // Set up sws for RGBA conversion
-        sws_ctx = sws_getContext(width, height, codec_ctx->pix_fmt,
-                                 width, height, AV_PIX_FMT_RGBA,
-                                 SWS_BILINEAR, nullptr, nullptr, nullptr);
-        if (!sws_ctx) {
-            std::cerr << "Cannot create sws context\n";
-            return false;
+        int current = decoder.output_shift;
+        if (shift > current) {
+            while (shift > current && need * 1.25f > 1.0f / (1 << shift)) --shift;
+            double now = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            if (shift == current) {
+                shrink_since = -1.0;
+                return;
+            }
+            if (shrink_since < 0.0) shrink_since = now;
+            if (now - shrink_since < 0.5) return;
         }
-        
-        // Allocate buffer for RGBA
-        int numBytes = av_image_get_buffer_size(AV_PIX_FMT_RGBA, width, height, 1);
-        buffer = (uint8_t*)av_malloc(numBytes * sizeof(uint8_t));
-        av_image_fill_arrays(frame_rgb->data, frame_rgb->linesize, buffer, AV_PIX_FMT_RGBA, width, height, 1);
-        
-        // Calculate total frames
-        AVStream* stream = fmt_ctx->streams[video_stream_idx];
-        if (stream->nb_frames > 0) {
-            total_frames = stream->nb_frames;
-        } else if (stream->duration > 0 && stream->avg_frame_rate.num > 0) {
-            total_frames = (int)(stream->duration * stream->avg_frame_rate.num / (stream->avg_frame_rate.den * stream->time_base.den));
+        shrink_since = -1.0;
+        if (shift == current) return;
+
+        stop_decoder();
+        if (!decoder.set_output_scale(shift)) {
+            std::cerr << "Cannot rescale video output: " << path << "\n";
         }
-        
-        std::cout << "Video opened: " << path << " (" << width << "x" << height << ", " << total_frames << " frames)\n";
+        apply_settings();  // Reallocates the ring for the new size; the worker seeks back to the frame on screen
+    }
+
+    // Phase 18: frame cache budget; zero unless this source keeps a cache
+    size_t cache_budget() const { return decoder.cache_enabled ? (size_t)settings->frame_cache_mb << 20 : 0; }
+
+    // Phase 18: Puts a cached copy of `frame_idx` on screen, if there is one
+    bool show_cached(int frame_idx) {
+        if (!decoder.cache_enabled || !decoder.cache.copy_frame(frame_idx, cached_frame)) return false;
+        push_history();
+        if (uploader.ready()) {
+            uploader.upload(texture, cached_frame);
+        } else {
+            texture.upload(cached_frame);  // The PBO ring is busy; a scrub frame is worth one direct upload
+        }
+        on_screen_seconds = decoder.frame_index_seconds(frame_idx);
+        decoder.current_frame.store(frame_idx, std::memory_order_release);
         return true;
     }
-    
-    bool get_frame(uint8_t*& rgba_data, int& w, int& h) {
-        if (!frame_rgb || !sws_ctx) return false;
-        
-        AVPacket* packet = av_packet_alloc();
-        if (!packet) return false;
-        
-        while (av_read_frame(fmt_ctx, packet) >= 0) {
-            if (packet->stream_index == video_stream_idx) {
-                avcodec_send_packet(codec_ctx, packet);
-                if (avcodec_receive_frame(codec_ctx, frame) == 0) {
-                    // Convert to RGBA
-                    sws_scale(sws_ctx, frame->data, frame->linesize, 0, height,
-                              frame_rgb->data, frame_rgb->linesize);
-                    
-                    rgba_data = frame_rgb->data[0];
-                    w = width;
-                    h = height;
-                    current_frame++;
-                    av_packet_free(&packet);
-                    return true;
-                }
-            }
-            av_packet_unref(packet);
+
+    // Phase 18: Shows `frame_idx` while the slider is dragged without an exact
+    // seek: the cached frame if there is one, otherwise the keyframe at or before
+    // it (one decoded frame, re-requested only when the drag crosses into another
+    // GOP). Returns the PTS put on screen so the master clock can follow.
+    double scrub_to_frame(int frame_idx) {
+        scrub_frame = frame_idx;
+        if (show_cached(frame_idx)) {
+            scrub_hold = true;
+            return on_screen_seconds;
         }
-        
-        av_packet_free(&packet);
-        return false;
+        scrub_hold = false;
+        int key = !decoder.has_index() ? frame_idx : decoder.index.keyframe_before(frame_idx);
+        if (key != scrub_keyframe) {
+            scrub_keyframe = key;
+            decoder.seek_to_frame(key);
+            on_screen_seconds = -1.0;
+            clear_history();
+        }
+        return decoder.frame_index_seconds(key);
     }
-    
-    void seek_to_frame(int frame_idx) {
-        if (!fmt_ctx || video_stream_idx < 0) return;
-        
-        AVStream* stream = fmt_ctx->streams[video_stream_idx];
-        int64_t ts = (int64_t)frame_idx * stream->avg_frame_rate.den / stream->avg_frame_rate.num;
-        av_seek_frame(fmt_ctx, video_stream_idx, ts, AVSEEK_FLAG_BACKWARD);
-        avcodec_flush_buffers(codec_ctx);
-        current_frame = frame_idx;
+
+    void end_scrub() {
+        scrub_frame = -1;
+        scrub_keyframe = -1;
+        scrub_hold = false;
     }
-};
 
-// Phase 4: Texture/Media management structure
-struct TextureAsset {
-    GLuint gl_texture = 0;
-    int width = 0, height = 0;
-    int channels = 0;
-    char filepath[256] = {};
-    
-    TextureAsset() = default;
-    
-    ~TextureAsset() {
-        if (gl_texture) glDeleteTextures(1, &gl_texture);
+    // Phase 11: Follow a jump of the master clock
+    void seek_seconds(double seconds) {
+        if (!loaded) return;
+        double loop_offset = 0.0;  // Phase 19: lands in the loop iteration the clock is in
+        double source_seconds = decoder.loop_source_seconds(std::max(0.0, seconds - time_offset), loop_offset);
+        decoder.seek_to_frame(decoder.frame_at_seconds(source_seconds), loop_offset);
+        on_screen_seconds = -1.0;
+        clear_history();
     }
-    
-    bool load_from_file(const std::string& path) {
-        int w, h, c;
-        unsigned char* data = stbi_load(path.c_str(), &w, &h, &c, 4);  // Force RGBA
-        if (!data) {
-            std::cerr << "Failed to load image: " << path << "\n";
+
+    // Phase 11: Show the frame whose PTS matches the master clock, repeating or
+    // dropping decoded frames as needed. Returns true if the texture changed.
+    bool update(double master_now, bool playing) {
+        if (!loaded || !texture.valid() || scrub_hold) return false;
+        double now = std::max(0.0, master_now - time_offset);
+
+        if (suspended) {
+            // Phase 21: the worker follows the show time with the warm frame
+            if (now != warm_requested_at && decoder.worker_running) {
+                decoder.warm_request = now;
+                warm_requested_at = now;
+            }
             return false;
         }
+
+        decoder.clock_seconds = now;
+        DecodeStats& ds = decoder.stats;
+        bool frame_due = on_screen_seconds < 0.0 || now >= on_screen_seconds + decoder.frame_duration;
+
+        // Phase 14: if the GPU still owns the next PBO, keep the current frame rather than wait
+        if (!uploader.ready()) {
+            if (frame_due) uploader.busy_skips++;
+            return false;
+        }
+
+        if (decoder.worker_running) {
+            // Phase 15: give mapped slots back to the decoder once the GPU is done with them
+            decoder.ring.retire_completed([](DecodedFrame& slot) {
+                if (!slot.upload_fence) return true;
+                GLenum state = glClientWaitSync(slot.upload_fence, 0, 0);
+                if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED) return false;
+                glDeleteSync(slot.upload_fence);
+                slot.upload_fence = nullptr;
+                return true;
+            });
+
+            // Phase 10: Only pop from the ring; never wait on the decode thread
+            DecodedFrame* decoded = decoder.select_decoded(now);
+            if (!decoded) {
+                if (frame_due && !decoder.worker_eof) {
+                    ds.underruns++;
+                } else if (playing) {
+                    ds.frames_repeated++;
+                }
+                decoder.update_ring_stats(std::max(0.0, on_screen_seconds));
+                return false;
+            }
+
+            push_history();
+            if (mapped_ptr) {
+                decoded->upload_fence = uploader.upload_mapped(texture, *decoded, mapped_buffer, mapped_ptr);
+            } else {
+                uploader.upload(texture, *decoded);
+            }
+            float& avg = staging_ms[mapped_ptr ? 1 : 0];
+            float cost = ds.last_convert_ms + uploader.last_upload_ms;
+            avg = avg == 0.0f ? cost : avg * 0.95f + cost * 0.05f;
+
+            decoder.current_frame.store(decoded->frame_index, std::memory_order_release);
+            on_screen_seconds = decoded->pts_seconds;
+            decoder.release_decoded();
+            decoder.update_ring_stats(on_screen_seconds);
+            return true;
+        }
+
+        if (!frame_due) {
+            if (playing) ds.frames_repeated++;
+            return false;
+        }
+
+        DecodedFrame decoded;
+        if (!decoder.get_frame(now, decoded)) return false;
+        push_history();
+        on_screen_seconds = decoded.pts_seconds;
         
-        width = w;
-        height = h;
-        channels = 4;
-        strncpy(filepath, path.c_str(), sizeof(filepath) - 1);
-        filepath[sizeof(filepath) - 1] = '\0';
-        
-        // Create GL texture
-        if (gl_texture) glDeleteTextures(1, &gl_texture);
-        glGenTextures(1, &gl_texture);
-        glBindTexture(GL_TEXTURE_2D, gl_texture);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        glBindTexture(GL_TEXTURE_2D, 0);
-        
-        stbi_image_free(data);
-        std::cout << "Loaded texture: " << path << " (" << width << "x" << height << ")\n";
+        // Update texture with new frame
+        uploader.upload(texture, decoded);
+        if (decoder.cache_enabled) decoder.cache.insert(decoded);
         return true;
     }
 };
 
+// Phase 16: A video file known to the library, assignable to layers
+struct VideoClip {
+    std::string path;
+    std::string name;
+    int width = 0, height = 0;
+    int total_frames = 0;
+};
+
 // Phase 4: Media/Project asset management
 struct MediaLibrary {
-    std::map<std::string, TextureAsset> textures;  // name -> texture
-    std::string selected_texture;
-    VideoDecoder video_decoder;
-    GLuint video_texture = 0;
+    // Phase 29: stills by handle; a path is imported once however often it is added
+    SlotMap<TextureAsset> textures;
+    std::unordered_map<std::string, TextureHandle> texture_paths;  // Absolute path -> handle
+    TextureHandle selected_texture;
+
+    // Phase 16: video sources. The pool and settings are declared first so they
+    // outlive every source that references them.
+    VideoSettings video_settings;
+    DecoderPool decoder_pool;
+    ImageImporter importer;          // Phase 24: stills decode on the pool, upload within a budget
+    TextureAtlas atlas;              // Phase 27: shared pages for small stills
+    // Phase 28: VRAM budget for stills, with totals as of the last frame
+    int vram_budget_mb = 1024;
+    uint64_t residency_frame = 0;
+    size_t resident_bytes = 0;
+    size_t evicted_bytes = 0;
+    uint32_t evictions = 0;
+    uint32_t restores = 0;
+    std::vector<TextureAsset*> eviction_candidates;  // Reused every frame
+    GLuint placeholder = 0;          // Phase 24: shown in the library while a still imports
+    std::vector<VideoClip> clips;
+    int selected_clip = -1;
+    std::unique_ptr<VideoSource> preview;  // Selected clip; also shown by layers without their own clip
     bool is_video_loaded = false;
+    PlaybackClock clock;             // Phase 11: master show clock
+
+    // Phase 17: layers bind to shared sources; a source lives while any layer holds it
+    struct LayerVideo {
+        std::shared_ptr<VideoSource> source;
+        double delay = 0.0;   // Seconds this layer trails its source
+        bool used = false;    // Bound during the current frame
+    };
+    std::map<int, LayerVideo> layer_videos;                   // Layer id -> binding
+    std::vector<std::shared_ptr<VideoSource>> layer_sources;  // Every source held by a layer
+
+    // Phase 17: what sharing saved, relative to one decoder per layer
+    struct SharingStats {
+        int layers = 0;
+        int sources = 0;
+        int suspended = 0;  // Phase 21
+        size_t bytes_saved = 0;
+        double decode_ms_saved_per_sec = 0.0;
+    };
     
     ~MediaLibrary() {
-        if (video_texture) glDeleteTextures(1, &video_texture);
+        importer.stop();
+        layer_videos.clear();
+        layer_sources.clear();
+        preview.reset();
+        if (placeholder) glDeleteTextures(1, &placeholder);
+    }
+
+    // Phase 16: Split the machine's cores between FFmpeg's own threads for each stream
+    int auto_ffmpeg_threads() const {
+        int hw = std::max(1, (int)std::thread::hardware_concurrency());
+        int streams = 1 + (int)layer_sources.size();
+        return std::max(1, hw / streams);
     }
     
+    // Phase 24: Queues an image, or every image in a folder, for background import.
+    // Returns false only if nothing could be queued; decode errors show as failed assets.
     bool add_texture(const std::string& path) {
-        TextureAsset asset;
-        if (!asset.load_from_file(path)) return false;
-        
-        std::string name = std::filesystem::path(path).filename().string();
-        textures[name] = std::move(asset);
-        selected_texture = name;
-        return true;
+        std::error_code ec;
+        if (!std::filesystem::is_directory(path, ec)) return (bool)queue_texture(path);
+
+        std::vector<std::string> files;
+        for (const auto& entry : std::filesystem::directory_iterator(path, ec)) {
+            if (is_image_file(entry.path())) files.push_back(entry.path().string());
+        }
+        std::sort(files.begin(), files.end());
+        bool queued = false;
+        for (const std::string& file : files) queued |= (bool)queue_texture(file);
+        return queued;
+    }
+
+    // Phase 29: Handle of the still at `path`, queueing its import the first time.
+    // A failed import is retried; anything else already known is returned as is.
+    TextureHandle queue_texture(const std::string& path, bool select = true) {
+        std::error_code ec;
+        std::string key = std::filesystem::absolute(path, ec).lexically_normal().string();
+        if (ec) key = path;
+        if (key.size() >= sizeof(TextureAsset::filepath)) {
+            std::cerr << "Image path too long: " << path << "\n";
+            return TextureHandle();
+        }
+
+        auto it = texture_paths.find(key);
+        TextureAsset* asset = it != texture_paths.end() ? textures.get(it->second) : nullptr;
+        if (!asset) {
+            TextureHandle handle = textures.insert();
+            texture_paths[key] = handle;
+            asset = textures.get(handle);
+            asset->handle = handle;
+            strncpy(asset->filepath, key.c_str(), sizeof(asset->filepath) - 1);
+            importer.enqueue(*asset, decoder_pool);
+        } else if (asset->state == AssetState::Failed) {
+            importer.enqueue(*asset, decoder_pool);
+        }
+        if (select) selected_texture = asset->handle;
+        return asset->handle;
+    }
+
+    // Phase 29: O(1); follows a duplicate to the asset it shares. nullptr once
+    // the handle's asset has been removed.
+    TextureAsset* get(TextureHandle handle) const {
+        TextureAsset* asset = textures.get(handle);
+        if (asset && asset->source) return textures.get(asset->source);
+        return asset;
+    }
+
+    // Phase 29: Drops a still that has finished importing. Its handles go stale;
+    // stills that were sharing its content are imported on their own.
+    bool remove_texture(TextureHandle handle) {
+        TextureAsset* asset = textures.get(handle);
+        if (!asset || asset->importing()) return false;
+        atlas.remove(*asset);
+        importer.forget(*asset);
+        texture_paths.erase(asset->filepath);
+        textures.for_each([&](TextureHandle, TextureAsset& other) {
+            if (other.source == handle && !other.importing()) {
+                importer.enqueue(other, decoder_pool);
+            } else if (other.state.load(std::memory_order_acquire) == AssetState::Uploading && other.duplicate_of == handle) {
+                importer.requeue_duplicate(other);  // Matched but not yet published
+            }
+        });
+        if (selected_texture == handle) selected_texture = TextureHandle();
+        return textures.erase(handle);
+    }
+
+    // Phase 24: Once per frame on the render thread
+    void upload_imports() {
+        importer.upload(textures);
+
+        // Phase 27: pack small stills as they arrive; earlier entries never move
+        if (importer.atlas_ready.empty()) return;
+        for (TextureAsset* asset : importer.atlas_ready) {
+            asset->state = atlas.insert(*asset) ? AssetState::Ready : AssetState::Failed;
+        }
+        importer.atlas_ready.clear();
+        atlas.update_mips();
+    }
+
+    // Phase 24: Grey checkerboard standing in for stills that aren't ready yet
+    GLuint placeholder_texture() {
+        if (placeholder) return placeholder;
+        uint8_t pixels[8 * 8 * 4];
+        for (int i = 0; i < 64; ++i) {
+            uint8_t v = ((i % 8) / 2 + (i / 8) / 2) % 2 ? 96 : 64;
+            pixels[i * 4 + 0] = pixels[i * 4 + 1] = pixels[i * 4 + 2] = v;
+            pixels[i * 4 + 3] = 255;
+        }
+        glGenTextures(1, &placeholder);
+        glBindTexture(GL_TEXTURE_2D, placeholder);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 8, 8, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return placeholder;
     }
     
     bool load_video(const std::string& path) {
-        if (!video_decoder.open(path)) return false;
-        
-        // Create initial video texture
-        if (video_texture) glDeleteTextures(1, &video_texture);
-        glGenTextures(1, &video_texture);
-        glBindTexture(GL_TEXTURE_2D, video_texture);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, video_decoder.width, video_decoder.height, 
-                    0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-        glBindTexture(GL_TEXTURE_2D, 0);
-        
+        auto source = std::make_unique<VideoSource>(video_settings, decoder_pool);
+        source->decoder.cache_enabled = true;  // Phase 18: the preview is the source the timeline scrubs
+        if (!source->open(path, auto_ffmpeg_threads(), 0.0)) return false;
+
+        clock.seek(0.0);
+        int clip_idx = -1;
+        for (int i = 0; i < (int)clips.size(); ++i) {
+            if (clips[i].path == path) clip_idx = i;
+        }
+        if (clip_idx < 0) {
+            VideoClip clip;
+            clip.path = path;
+            clip.name = std::filesystem::path(path).filename().string();
+            clip.width = source->decoder.width;
+            clip.height = source->decoder.height;
+            clip.total_frames = source->decoder.total_frames;
+            clips.push_back(clip);
+            clip_idx = (int)clips.size() - 1;
+        }
+
+        preview = std::move(source);
+        selected_clip = clip_idx;
         is_video_loaded = true;
-        selected_texture = std::filesystem::path(path).filename().string();
+        selected_texture = TextureHandle();
         return true;
     }
-    
-    bool update_video_frame() {
-        if (!is_video_loaded || !video_texture) return false;
-        
-        uint8_t* rgba_data = nullptr;
-        int w, h;
-        if (!video_decoder.get_frame(rgba_data, w, h)) return false;
-        
-        // Update texture with new frame
-        glBindTexture(GL_TEXTURE_2D, video_texture);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba_data);
-        glBindTexture(GL_TEXTURE_2D, 0);
-        return true;
+
+    // Phase 16: Binds a layer to a source playing `path`, `offset` seconds behind
+    // the master clock. Layers must bind every frame; unbound ones are released.
+    // Phase 17: a source already playing the clip is shared when the offset falls
+    // inside its history window; otherwise a new one is opened.
+    // Phase 20: `footprint_w/h` is the layer's on-screen size, driving the source's output scale
+    // Phase 21: hidden layers stay bound so their source can be suspended warm
+    void bind_layer_video(int layer_id, const char* path, double offset, bool visible,
+                          float footprint_w, float footprint_h) {
+        LayerVideo& binding = layer_videos[layer_id];
+        binding.used = true;
+        if (!binding.source || binding.source->path != path || !binding.source->can_serve(offset)) {
+            binding.source.reset();
+            for (const auto& source : layer_sources) {
+                if (source->path == path && source->can_serve(offset)) {
+                    binding.source = source;
+                    break;
+                }
+            }
+        }
+        if (!binding.source) {
+            auto source = std::make_shared<VideoSource>(video_settings, decoder_pool);
+            source->time_offset = offset;
+            if (!source->open(path, auto_ffmpeg_threads(), std::max(0.0, clock.now() - offset))) {
+                std::cerr << "Failed to open video for layer " << layer_id << ": " << path << "\n";
+            }
+            layer_sources.push_back(source);
+            binding.source = source;
+        }
+        binding.delay = offset - binding.source->time_offset;
+        binding.source->max_delay = std::max(binding.source->max_delay, binding.delay);
+        if (visible) {
+            binding.source->visible_consumers++;
+            binding.source->add_footprint(footprint_w, footprint_h);
+        }
+    }
+
+    // Phase 21: a layer un-hidden after binding (show mode keys) shows its warm frame this frame.
+    // Returns whether a texture was uploaded to, outside the renderer's state cache.
+    bool resume_layer_video(int layer_id) {
+        auto it = layer_videos.find(layer_id);
+        return it != layer_videos.end() && it->second.source->resume(clock.now());
+    }
+
+    void add_preview_footprint(float w, float h) {
+        if (preview) preview->add_footprint(w, h);
+    }
+
+    // Phase 20: after all layers are bound for this frame
+    // Phase 21: also suspends sources nobody can see and resumes the rest
+    void update_output_scales() {
+        if (preview) preview->update_output_scale();
+        for (auto& source : layer_sources) {
+            if (source->visible_consumers == 0) {
+                source->suspend();
+            } else {
+                source->resume(clock.now());
+            }
+            source->visible_consumers = 0;
+            source->update_output_scale();
+        }
+    }
+
+    // Texture to draw for a layer's own clip, or nullptr if it has none
+    const FrameTextures* layer_texture(int layer_id) const {
+        auto it = layer_videos.find(layer_id);
+        if (it == layer_videos.end() || !it->second.source->loaded) return nullptr;
+        const FrameTextures& texture = it->second.source->texture_delayed(it->second.delay);
+        return texture.valid() ? &texture : nullptr;
+    }
+
+    void release_unused_layer_videos() {
+        for (auto it = layer_videos.begin(); it != layer_videos.end();) {
+            if (!it->second.used) {
+                it = layer_videos.erase(it);
+            } else {
+                it->second.used = false;
+                ++it;
+            }
+        }
+        // The library's own reference is the last one once no layer holds a source
+        layer_sources.erase(std::remove_if(layer_sources.begin(), layer_sources.end(),
+                                           [](const std::shared_ptr<VideoSource>& s) { return s.use_count() == 1; }),
+                            layer_sources.end());
+        for (const auto& source : layer_sources) {
+            source->set_history_enabled(source->max_delay > 0.0);
+            source->max_delay = 0.0;
+        }
+    }
+
+    SharingStats sharing_stats() const {
+        SharingStats st;
+        st.layers = (int)layer_videos.size();
+        st.sources = (int)layer_sources.size();
+        for (const auto& source : layer_sources) {
+            if (source->suspended) st.suspended++;
+            int extra = (int)source.use_count() - 2;  // Layers beyond the first, not counting our reference
+            if (extra <= 0 || !source->loaded) continue;
+            size_t history_bytes = layout_frame_bytes(source->decoder.output_layout, source->decoder.width,
+                                                      source->decoder.height) * source->history.size();
+            size_t duplicate_bytes = (source->memory_bytes() - history_bytes) * extra;
+            st.bytes_saved += duplicate_bytes > history_bytes ? duplicate_bytes - history_bytes : 0;
+            if (source->decoder.frame_duration > 0.0) {
+                st.decode_ms_saved_per_sec += extra * source->decoder.stats.last_decode_ms / source->decoder.frame_duration;
+            }
+        }
+        return st;
+    }
+
+    // Phase 16: Push changed VideoSettings to every source
+    void apply_video_settings() {
+        if (preview) preview->apply_settings();
+        for (auto& source : layer_sources) source->apply_settings();
+    }
+
+    // Phase 11: Seek the master clock and every source with it
+    // Phase 18: a cached target frame is shown at once while the decoder seeks
+    void seek_video(int frame_idx) {
+        if (!preview) return;
+        double seconds = preview->decoder.frame_index_seconds(frame_idx);
+        clock.seek(seconds);
+        preview->end_scrub();
+        preview->decoder.seek_to_frame(frame_idx);
+        preview->on_screen_seconds = -1.0;
+        preview->show_cached(frame_idx);
+        for (auto& source : layer_sources) source->seek_seconds(seconds);
+    }
+
+    // Phase 18: Cheap preview while the frame slider is dragged; layer sources
+    // catch up on the exact seek_video() issued when the drag ends
+    void scrub_video(int frame_idx) {
+        if (!preview) return;
+        clock.seek(preview->scrub_to_frame(frame_idx));
+    }
+
+    // Phase 19: loop mode applies to every source; in/out points are per source
+    void apply_loop_mode() {
+        if (preview) preview->decoder.loop_enabled = video_settings.loop_playback;
+        for (auto& source : layer_sources) source->decoder.loop_enabled = video_settings.loop_playback;
+    }
+
+    // Phase 18: only the preview keeps a cache; layer sources never scrub
+    void apply_cache_budget() {
+        if (preview) preview->decoder.cache.set_budget(preview->cache_budget());
+    }
+
+    // Phase 16: Advance every source to the master clock
+    void update_videos() {
+        double now = clock.now();
+        if (preview) preview->update(now, clock.playing);
+        for (auto& source : layer_sources) source->update(now, clock.playing);
     }
     
+    // Phase 28: Render thread, whenever a layer or the preview draws `asset`.
+    // An evicted asset is queued to come back.
+    void touch(TextureAsset& asset) {
+        asset.last_rendered = residency_frame;
+        if (asset.state == AssetState::Evicted) {
+            importer.restore(asset);
+            restores++;
+        }
+    }
+
+    // Phase 28: Once per frame, after uploads. Whole-texture stills not drawn in
+    // the last frame are evicted, least recently drawn first, until the stills
+    // fit the budget. Atlas pages and tiled stills count towards it but are
+    // not evicted here; tiles are evicted by their own TiledImage.
+    void enforce_vram_budget() {
+        residency_frame++;
+        size_t evicted = 0;
+        eviction_candidates.clear();
+        size_t resident = atlas.resident_bytes();  // Whole pages; an entry's cell is already part of one
+        textures.for_each([&](TextureHandle, TextureAsset& asset) {
+            if (!asset.atlas_texture) resident += asset.resident_bytes();
+            evicted += asset.evicted_bytes();
+            if (asset.state == AssetState::Ready && asset.gl_texture && !asset.staged.empty() &&
+                asset.last_rendered + 1 < residency_frame) {
+                eviction_candidates.push_back(&asset);
+            }
+        });
+
+        size_t budget = (size_t)std::max(1, vram_budget_mb) << 20;
+        if (resident > budget) {
+            std::sort(eviction_candidates.begin(), eviction_candidates.end(),
+                      [](const TextureAsset* a, const TextureAsset* b) { return a->last_rendered < b->last_rendered; });
+            for (TextureAsset* asset : eviction_candidates) {
+                if (resident <= budget) break;
+                asset->gl_texture.reset();
+                asset->state = AssetState::Evicted;
+                asset->evictions++;
+                resident -= asset->gpu_bytes;
+                evicted += asset->gpu_bytes;
+                evictions++;
+            }
+        }
+        resident_bytes = resident;
+        evicted_bytes = evicted;
+    }
+
     TextureAsset* get_selected() {
-        if (selected_texture.empty() || textures.find(selected_texture) == textures.end()) {
-            return nullptr;
+        return get(selected_texture);
+    }
+};
+
+// Phase 3: Quad mapping structure
+struct Quad {
+    ImVec2 corners[4];  // 0=TL, 1=TR, 2=BR, 3=BL
+    char name[64];
+    bool selected = false;
+    
+    Quad(const std::string& n = "") : selected(false) {
+        strncpy(name, n.c_str(), sizeof(name) - 1);
+        name[sizeof(name) - 1] = '\0';
+        corners[0] = ImVec2(100, 100);
+        corners[1] = ImVec2(300, 100);
+        corners[2] = ImVec2(300, 300);
+        corners[3] = ImVec2(100, 300);
+    }
+
+    // Phase 20: approximate on-screen size, from the longer of each pair of opposite edges
+    void projected_size(float& w, float& h) const {
+        auto edge = [](ImVec2 a, ImVec2 b) { return std::sqrt((a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y)); };
+        w = std::max(edge(corners[0], corners[1]), edge(corners[3], corners[2]));
+        h = std::max(edge(corners[0], corners[3]), edge(corners[1], corners[2]));
+    }
+};
+
+// Phase 33: One stage of a layer's effect chain. Which stages are enabled, and
+// in what order, picks the fused shader (effect_structure()); everything else
+// is uniforms, so dragging a slider never recompiles.
+struct LayerEffect {
+    enum Type { ColorAdjust, ChromaKey, Blur, MaskRect, MaskEllipse, TypeCount };
+
+    int type = ColorAdjust;
+    bool enabled = true;
+    // ColorAdjust: params = brightness, contrast, saturation, gamma
+    // ChromaKey:   color.rgb = key colour, params.x = threshold, params.y = softness
+    // Blur:        params.x = radius in texels
+    // Mask*:       params = min.xy, max.xy in quad space (0-1), color.x = feather, color.y = invert
+    float params[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+    float color[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+    static const char* type_name(int type) {
+        static const char* names[TypeCount] = {"Color Adjust", "Chroma Key", "Blur", "Mask (Rect)", "Mask (Ellipse)"};
+        return type >= 0 && type < TypeCount ? names[type] : "Unknown";
+    }
+
+    static LayerEffect make(int type) {
+        LayerEffect e;
+        e.type = type;
+        switch (type) {
+            case ChromaKey:
+                e.params[0] = 0.1f; e.params[1] = 0.05f;
+                e.color[1] = 1.0f;  // Green screen
+                break;
+            case Blur:
+                e.params[0] = 4.0f;
+                break;
+            case MaskRect:
+            case MaskEllipse:
+                e.params[0] = 0.0f; e.params[1] = 0.0f; e.params[2] = 1.0f; e.params[3] = 1.0f;
+                e.color[0] = 0.05f;
+                break;
+            default:
+                break;
         }
-        return &textures[selected_texture];
+        return e;
     }
 };
 
-// Phase 3: Quad mapping structure
-struct Quad {
-    ImVec2 corners[4];  // 0=TL, 1=TR, 2=BR, 3=BL
-    char name[64];
-    bool selected = false;
-    
-    Quad(const std::string& n = "") : selected(false) {
-        strncpy(name, n.c_str(), sizeof(name) - 1);
-        name[sizeof(name) - 1] = '\0';
-        corners[0] = ImVec2(100, 100);
-        corners[1] = ImVec2(300, 100);
-        corners[2] = ImVec2(300, 300);
-        corners[3] = ImVec2(100, 300);
+constexpr int kMaxLayerEffects = 8;  // Enabled stages per layer; 3 bits each in effect_structure()
+
+// Phase 33: A blur samples the texture at 25 taps, so it can only run on the
+// frame itself (each tap would otherwise re-run every stage before it). Chains
+// hold at most one, first; the editor keeps them that way and this fixes up
+// chains loaded from older scenes.
+inline void pin_blur_first(std::vector<LayerEffect>& effects) {
+    auto blur = std::find_if(effects.begin(), effects.end(), [](const LayerEffect& e) { return e.type == LayerEffect::Blur; });
+    if (blur == effects.end()) return;
+    std::rotate(effects.begin(), blur, blur + 1);
+    effects.erase(std::remove_if(effects.begin() + 1, effects.end(),
+                                 [](const LayerEffect& e) { return e.type == LayerEffect::Blur; }),
+                  effects.end());
+}
+
+// Phase 33: Calls f(effect, stage) for the enabled stages in list order and
+// returns how many there are. A blur anywhere but first (see pin_blur_first())
+// is skipped rather than compiled into a chain.
+template <typename F>
+inline int for_each_effect_stage(const std::vector<LayerEffect>& effects, F&& f) {
+    int stage = 0;
+    for (const LayerEffect& e : effects) {
+        if (!e.enabled || stage == kMaxLayerEffects || (e.type == LayerEffect::Blur && stage > 0)) continue;
+        f(e, stage++);
+    }
+    return stage;
+}
+
+// Phase 33: Enabled stage types in shader order, (type + 1) per 3 bits; 0 = no effects
+inline uint32_t effect_structure(const std::vector<LayerEffect>& effects) {
+    uint32_t structure = 0;
+    for_each_effect_stage(effects, [&](const LayerEffect& e, int stage) {
+        structure |= (uint32_t)(e.type + 1) << (3 * stage);
+    });
+    return structure;
+}
+
+// Phase 33: Enabled stages' uniforms, in the order effect_structure() lists them
+inline int pack_effect_uniforms(const std::vector<LayerEffect>& effects, float params[][4], float colors[][4]) {
+    return for_each_effect_stage(effects, [&](const LayerEffect& e, int stage) {
+        memcpy(params[stage], e.params, sizeof(e.params));
+        memcpy(colors[stage], e.color, sizeof(e.color));
+    });
+}
+
+// Phase 33: GLSL defining fx_chain(uv, local) for a structure. Stage N reads
+// stage N - 1 (stage 0 is the frame itself), so the whole chain is one pass; a
+// blur is only ever stage 1 and samples the frame directly.
+inline std::string effect_chain_source(uint32_t structure) {
+    static const char* stages[LayerEffect::TypeCount] = {
+        // ColorAdjust
+        R"(
+            vec4 fx_stage$N(vec2 uv, vec2 local) {
+                vec4 c = fx_stage$P(uv, local);
+                vec4 p = fx_params[$P];
+                c.rgb = ((c.rgb - 0.5) * p.y + 0.5) * p.x;
+                c.rgb = mix(vec3(dot(c.rgb, vec3(0.2126, 0.7152, 0.0722))), c.rgb, p.z);
+                c.rgb = pow(max(c.rgb, 0.0), vec3(1.0 / max(p.w, 0.01)));
+                return c;
+            }
+        )",
+        // ChromaKey: distance from the key colour in CbCr, so brightness doesn't matter
+        R"(
+            vec4 fx_stage$N(vec2 uv, vec2 local) {
+                vec4 c = fx_stage$P(uv, local);
+                vec4 p = fx_params[$P];
+                float d = length(fx_cbcr(c.rgb) - fx_cbcr(fx_color[$P].rgb));
+                c.a *= smoothstep(p.x, p.x + max(p.y, 1e-4), d);
+                return c;
+            }
+        )",
+        // Blur: 5x5 gaussian of the frame, alpha weighted so keyed-out pixels don't
+        // bleed in dark. Taps stay half a texel inside tex_rect, so an atlas entry
+        // or a tile never picks up its neighbour beyond the padding or border.
+        R"(
+            vec4 fx_stage$N(vec2 uv, vec2 local) {
+                vec2 texel = 1.0 / vec2(textureSize(tex, 0));
+                vec2 step_uv = fx_params[$P].x * 0.5 * texel;
+                vec2 lo = min(tex_rect.xy, tex_rect.zw) + 0.5 * texel;
+                vec2 hi = max(tex_rect.xy, tex_rect.zw) - 0.5 * texel;
+                vec4 sum = vec4(0.0);
+                float total = 0.0;
+                for (int y = -2; y <= 2; ++y) {
+                    for (int x = -2; x <= 2; ++x) {
+                        float w = exp(-0.5 * float(x * x + y * y));
+                        vec4 s = sample_frame(clamp(uv + vec2(x, y) * step_uv, lo, hi));
+                        sum += w * vec4(s.rgb * s.a, s.a);
+                        total += w;
+                    }
+                }
+                return sum.a > 0.0 ? vec4(sum.rgb / sum.a, sum.a / total) : vec4(0.0);
+            }
+        )",
+        // MaskRect
+        R"(
+            vec4 fx_stage$N(vec2 uv, vec2 local) {
+                vec4 c = fx_stage$P(uv, local);
+                vec4 r = fx_params[$P];
+                vec2 e = max(r.xy - local, local - r.zw);
+                c.a *= fx_mask(max(e.x, e.y), fx_color[$P]);
+                return c;
+            }
+        )",
+        // MaskEllipse
+        R"(
+            vec4 fx_stage$N(vec2 uv, vec2 local) {
+                vec4 c = fx_stage$P(uv, local);
+                vec4 r = fx_params[$P];
+                vec2 radius = max((r.zw - r.xy) * 0.5, vec2(1e-4));
+                float d = length((local - (r.xy + r.zw) * 0.5) / radius) - 1.0;
+                c.a *= fx_mask(d * min(radius.x, radius.y), fx_color[$P]);
+                return c;
+            }
+        )",
+    };
+
+    std::string source = R"(
+            uniform vec4 fx_params[)" + std::to_string(kMaxLayerEffects) + R"(];
+            uniform vec4 fx_color[)" + std::to_string(kMaxLayerEffects) + R"(];
+            uniform vec4 tex_rect;  // Shared with the vertex stage; effect variants are never instanced
+
+            vec2 fx_cbcr(vec3 c) {
+                return vec2(dot(c, vec3(-0.1687, -0.3313, 0.5)), dot(c, vec3(0.5, -0.4187, -0.0813)));
+            }
+
+            // Coverage for a signed distance outside the mask edge; feather fades inwards
+            float fx_mask(float outside, vec4 settings) {
+                float m = 1.0 - smoothstep(-max(settings.x, 1e-4), 0.0, outside);
+                return mix(m, 1.0 - m, settings.y);
+            }
+
+            vec4 fx_stage0(vec2 uv, vec2 local) { return sample_frame(uv); }
+    )";
+    int stage = 0;
+    for (; structure; structure >>= 3) {
+        int type = (int)(structure & 7) - 1;
+        if (type < 0 || type >= LayerEffect::TypeCount) break;
+        std::string body = stages[type];
+        stage++;
+        for (size_t at; (at = body.find("$N")) != std::string::npos;) body.replace(at, 2, std::to_string(stage));
+        for (size_t at; (at = body.find("$P")) != std::string::npos;) body.replace(at, 2, std::to_string(stage - 1));
+        source += body;
     }
-};
+    source += "\n            vec4 fx_chain(vec2 uv, vec2 local) { return fx_stage" + std::to_string(stage) + "(uv, local); }\n";
+    return source;
+}
 
 // Phase 6: Layer management structure
 struct Layer {
     char name[64] = {};
     int quad_idx = -1;  // Reference to quad
-    int texture_idx = -1;  // Index into media library textures
+    char texture_path[256] = {};  // Phase 29: still shown by this layer (empty = media library selection)
+    TextureHandle texture;        // Phase 29: runtime handle for texture_path
     float opacity = 1.0f;
     int blend_mode = 0;  // 0=Alpha, 1=Add, 2=Multiply
     bool visible = true;
     int z_order = 0;  // Higher = on top
+    int id = 0;  // Phase 16: stable runtime id keying the layer's video source
+    char video_path[256] = {};  // Phase 16: clip played by this layer (empty = media library preview)
+    float video_offset = 0.0f;  // Phase 17: seconds this layer's clip trails the master clock
+    std::vector<LayerEffect> effects;  // Phase 33: applied in order, fused into the layer's shader
     
     Layer(const std::string& n = "") {
         strncpy(name, n.c_str(), sizeof(name) - 1);
@@ -318,10 +4724,12 @@ struct Layer {
 struct LayerCompositor {
     std::vector<Layer> layers;
     int selected_layer_idx = -1;
+    int next_layer_id = 1;
     
     void add_layer(const std::string& name) {
         Layer l(name);
         l.z_order = (int)layers.size();
+        l.id = next_layer_id++;
         layers.push_back(l);
         selected_layer_idx = (int)layers.size() - 1;
     }
@@ -346,6 +4754,11 @@ struct LayerCompositor {
             std::swap(layers[idx].z_order, layers[idx + 1].z_order);
         }
     }
+
+    // Phase 16: give layers loaded from a scene fresh ids
+    void assign_layer_ids() {
+        for (auto& l : layers) l.id = next_layer_id++;
+    }
 };
 
 // Phase 7: Scene persistence structure
@@ -388,11 +4801,22 @@ struct Scene {
             json layer_obj;
             layer_obj["name"] = l.name;
             layer_obj["quad_idx"] = l.quad_idx;
-            layer_obj["texture_idx"] = l.texture_idx;
+            layer_obj["texture_path"] = l.texture_path;
             layer_obj["opacity"] = l.opacity;
             layer_obj["blend_mode"] = l.blend_mode;
             layer_obj["visible"] = l.visible;
             layer_obj["z_order"] = l.z_order;
+            layer_obj["video_path"] = l.video_path;
+            layer_obj["video_offset"] = l.video_offset;
+            layer_obj["effects"] = json::array();  // Phase 33
+            for (const LayerEffect& e : l.effects) {
+                layer_obj["effects"].push_back({
+                    {"type", e.type},
+                    {"enabled", e.enabled},
+                    {"params", {e.params[0], e.params[1], e.params[2], e.params[3]}},
+                    {"color", {e.color[0], e.color[1], e.color[2], e.color[3]}}
+                });
+            }
             j["layers"].push_back(layer_obj);
         }
         
@@ -426,11 +4850,31 @@ struct Scene {
                 for (const auto& layer_obj : j["layers"]) {
                     Layer l(layer_obj.value("name", "Layer"));
                     l.quad_idx = layer_obj.value("quad_idx", -1);
-                    l.texture_idx = layer_obj.value("texture_idx", -1);
+                    std::string texture_path = layer_obj.value("texture_path", "");  // Phase 29: replaces texture_idx
+                    strncpy(l.texture_path, texture_path.c_str(), sizeof(l.texture_path) - 1);
                     l.opacity = layer_obj.value("opacity", 1.0f);
                     l.blend_mode = layer_obj.value("blend_mode", 0);
                     l.visible = layer_obj.value("visible", true);
                     l.z_order = layer_obj.value("z_order", 0);
+                    std::string video_path = layer_obj.value("video_path", "");
+                    strncpy(l.video_path, video_path.c_str(), sizeof(l.video_path) - 1);
+                    l.video_offset = layer_obj.value("video_offset", 0.0f);
+                    if (layer_obj.contains("effects")) {  // Phase 33
+                        for (const auto& effect_obj : layer_obj["effects"]) {
+                            int type = effect_obj.value("type", 0);
+                            if (type < 0 || type >= LayerEffect::TypeCount) continue;
+                            LayerEffect e = LayerEffect::make(type);
+                            e.enabled = effect_obj.value("enabled", true);
+                            for (int i = 0; i < 4 && effect_obj.contains("params") && i < (int)effect_obj["params"].size(); ++i) {
+                                e.params[i] = effect_obj["params"][i];
+                            }
+                            for (int i = 0; i < 4 && effect_obj.contains("color") && i < (int)effect_obj["color"].size(); ++i) {
+                                e.color[i] = effect_obj["color"][i];
+                            }
+                            l.effects.push_back(e);
+                        }
+                        pin_blur_first(l.effects);
+                    }
                     layers.push_back(l);
                 }
             }
@@ -443,12 +4887,317 @@ struct Scene {
     }
 };
 
+// Phase 31: Last-known GL state for the show renderer. Binds and state changes
+// that wouldn't change anything are skipped; everything that does reach GL is
+// counted per frame. Code that touches GL behind its back (ImGui's backend,
+// texture uploads) must be followed by invalidate().
+struct GlStateCache {
+    static constexpr int kTextureUnits = 4;
+    static constexpr GLuint kUnknown = ~0u;
+
+    struct Counters {
+        uint32_t draws = 0;
+        uint32_t binds = 0;            // Program, VAO, buffer and texture binds issued
+        uint32_t state_changes = 0;    // Active unit, blend and viewport changes issued
+        uint32_t uniform_uploads = 0;
+        uint32_t skipped = 0;          // Redundant calls not issued
+    };
+    Counters frame;       // So far this frame
+    Counters last_frame;  // The previous complete frame, for the OSD
+
+    GlStateCache() { invalidate(); }
+
+    // Start of each frame's rendering: everything else ran since the last one
+    void begin_frame() {
+        last_frame = frame;
+        frame = Counters();
+        invalidate();
+    }
+
+    void invalidate() {
+        program = vao = array_buffer = active_unit = kUnknown;
+        for (GLuint& texture : textures) texture = kUnknown;
+        blend = -1;
+        blend_src = blend_dst = kUnknown;
+        viewport[0] = viewport[1] = viewport[2] = viewport[3] = -1;
+    }
+
+    // After texture uploads made outside the cache (raw glBindTexture on the
+    // active unit); the active unit itself is unchanged
+    void invalidate_textures() {
+        for (GLuint& texture : textures) texture = kUnknown;
+    }
+
+    // Returns whether the program was actually (re)bound
+    bool use_program(GLuint p) {
+        if (p == program) { frame.skipped++; return false; }
+        glUseProgram(p);
+        program = p;
+        frame.binds++;
+        return true;
+    }
+
+    void bind_vertex_array(GLuint v) {
+        if (v == vao) { frame.skipped++; return; }
+        glBindVertexArray(v);
+        vao = v;
+        frame.binds++;
+    }
+
+    void bind_array_buffer(GLuint b) {
+        if (b == array_buffer) { frame.skipped++; return; }
+        glBindBuffer(GL_ARRAY_BUFFER, b);
+        array_buffer = b;
+        frame.binds++;
+    }
+
+    void bind_texture(int unit, GLuint texture) {
+        if (textures[unit] == texture) { frame.skipped++; return; }
+        if (active_unit != (GLuint)unit) {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            active_unit = unit;
+            frame.state_changes++;
+        }
+        glBindTexture(GL_TEXTURE_2D, texture);
+        textures[unit] = texture;
+        frame.binds++;
+    }
+
+    void set_blend(bool enabled, GLenum src = GL_SRC_ALPHA, GLenum dst = GL_ONE_MINUS_SRC_ALPHA) {
+        if (blend != (int)enabled) {
+            if (enabled) glEnable(GL_BLEND);
+            else glDisable(GL_BLEND);
+            blend = enabled;
+            frame.state_changes++;
+        } else {
+            frame.skipped++;
+        }
+        if (enabled && (src != blend_src || dst != blend_dst)) {
+            glBlendFunc(src, dst);
+            blend_src = src;
+            blend_dst = dst;
+            frame.state_changes++;
+        }
+    }
+
+    void set_viewport(int x, int y, int w, int h) {
+        if (viewport[0] == x && viewport[1] == y && viewport[2] == w && viewport[3] == h) { frame.skipped++; return; }
+        glViewport(x, y, w, h);
+        viewport[0] = x;
+        viewport[1] = y;
+        viewport[2] = w;
+        viewport[3] = h;
+        frame.state_changes++;
+    }
+
+    void count_uniforms(uint32_t n) { frame.uniform_uploads += n; }
+    void count_draw() { frame.draws++; }
+
+private:
+    GLuint program, vao, array_buffer, active_unit;
+    GLuint textures[kTextureUnits];
+    int blend;  // -1 unknown
+    GLenum blend_src, blend_dst;
+    int viewport[4];
+};
+
+// Phase 34: Linked shader programs on disk, one file per key. The key covers
+// every source string plus the driver's vendor, renderer and version, so a
+// driver update misses instead of loading a stale binary; a binary the driver
+// still rejects is deleted and the program rebuilt from source.
+struct ProgramBinaryCache {
+    static constexpr char kMagic[8] = {'V', 'L', 'X', 'P', 'R', 'G', '1', '\0'};
+
+    std::string directory = ".vlxcache";
+    bool enabled = false;      // Driver offers at least one binary format
+    uint64_t driver_hash = 0;
+
+    // This run
+    uint32_t hits = 0, misses = 0, rejected = 0;
+    double load_ms = 0.0;      // Loading cached binaries
+    double compile_ms = 0.0;   // Compiling and linking from source
+    double saved_ms = 0.0;     // Compile time recorded with each hit, less its load time
+
+    // Render thread, with the context current
+    void open() {
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        enabled = formats > 0;
+        driver_hash = fnv1a64(nullptr, 0);
+        for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+            const char* value = (const char*)glGetString(name);
+            if (value) driver_hash = fnv1a64((const uint8_t*)value, strlen(value) + 1, driver_hash);
+        }
+    }
+
+    uint64_t key_for(const char* const* sources, int count) const {
+        uint64_t key = driver_hash;
+        for (int i = 0; i < count; ++i) key = fnv1a64((const uint8_t*)sources[i], strlen(sources[i]) + 1, key);
+        return key;
+    }
+
+    std::string path_for(uint64_t key) const {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.vlxprog", (unsigned long long)key);
+        return (std::filesystem::path(directory) / name).string();
+    }
+
+    // A linked program, or 0 on a miss
+    GLuint load(uint64_t key) {
+        if (!enabled) return 0;
+        auto t0 = std::chrono::steady_clock::now();
+        std::string path = path_for(key);
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            misses++;
+            return 0;
+        }
+        char magic[sizeof(kMagic)] = {};
+        uint64_t stored_key = 0;
+        uint32_t format = 0, length = 0;
+        double stored_compile_ms = 0.0;
+        in.read(magic, sizeof(magic));
+        in.read((char*)&stored_key, sizeof(stored_key));
+        in.read((char*)&format, sizeof(format));
+        in.read((char*)&length, sizeof(length));
+        in.read((char*)&stored_compile_ms, sizeof(stored_compile_ms));
+        std::vector<char> binary;
+        if (in && memcmp(magic, kMagic, sizeof(kMagic)) == 0 && stored_key == key && length <= (64u << 20)) {
+            binary.resize(length);
+            in.read(binary.data(), length);
+        }
+        bool complete = !binary.empty() && (bool)in;
+        in.close();
+
+        GLuint program = 0;
+        GLint linked = GL_FALSE;
+        if (complete) {
+            program = glCreateProgram();
+            glProgramBinary(program, (GLenum)format, binary.data(), (GLsizei)binary.size());
+            glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        }
+        if (!linked) {
+            if (program) glDeleteProgram(program);
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+            rejected++;
+            misses++;
+            return 0;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        hits++;
+        load_ms += ms;
+        saved_ms += std::max(0.0, stored_compile_ms - ms);
+        return program;
+    }
+
+    // Program must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT.
+    // Written under a temporary name and renamed, so a reader never sees half a file.
+    bool store(uint64_t key, GLuint program, double program_compile_ms) const {
+        static std::atomic<uint32_t> temp_counter{0};
+        if (!enabled) return false;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) return false;
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+        std::string path = path_for(key);
+        std::string temp = path + ".tmp" + std::to_string(temp_counter++);
+        {
+            std::ofstream out(temp, std::ios::binary);
+            uint32_t fmt = format, size = (uint32_t)length;
+            out.write(kMagic, sizeof(kMagic));
+            out.write((const char*)&key, sizeof(key));
+            out.write((const char*)&fmt, sizeof(fmt));
+            out.write((const char*)&size, sizeof(size));
+            out.write((const char*)&program_compile_ms, sizeof(program_compile_ms));
+            out.write(binary.data(), length);
+            if (!out) {
+                out.close();
+                std::filesystem::remove(temp, ec);
+                return false;
+            }
+        }
+        std::filesystem::rename(temp, path, ec);
+        return !ec;
+    }
+
+    float hit_rate() const { return hits + misses ? (float)hits / (hits + misses) : 0.0f; }
+};
+
+// Phase 32: Which compiled program draws a layer. init() builds every
+// combination from one source with #defines, so no shader branches on a
+// uniform, and the blend mode also selects the fixed-function blend state.
+struct ShaderKey {
+    static constexpr int kBlendModes = 3;  // 0=Alpha, 1=Add, 2=Multiply
+    static constexpr int kLayouts = 3;     // FrameLayout
+    static constexpr int kCount = kBlendModes * kLayouts * 2;
+
+    int blend_mode = 0;
+    FrameLayout layout = FrameLayout::RGBA;
+    bool instanced = false;  // Phase 30 batch path; RGBA only
+    uint32_t effects = 0;    // Phase 33: effect_structure(); non-zero variants are built on first use
+
+    int index() const { return ((instanced ? kLayouts : 0) + (int)layout) * kBlendModes + blend_mode; }
+    bool operator==(const ShaderKey& other) const { return index() == other.index() && effects == other.effects; }
+};
+
+// Phase 32: src/dst factors for a blend mode. Multiply expects premultiplied
+// colour, so dst * (rgb * a + 1 - a) fades towards no change as opacity drops.
+inline void blend_factors(int blend_mode, GLenum& src, GLenum& dst) {
+    switch (blend_mode) {
+        case 1: src = GL_SRC_ALPHA; dst = GL_ONE; break;                  // Add
+        case 2: src = GL_DST_COLOR; dst = GL_ONE_MINUS_SRC_ALPHA; break;  // Multiply
+        default: src = GL_SRC_ALPHA; dst = GL_ONE_MINUS_SRC_ALPHA; break; // Alpha
+    }
+}
+
 // Phase 8: Simple projection/composition renderer
 class ProjectionRenderer {
 public:
     GLuint quad_vao = 0, quad_vbo = 0, quad_ebo = 0;
-    GLuint shader_program = 0;
     bool is_initialized = false;
+
+    // Phase 30: instanced path for RGBA layers. Each layer becomes one instance;
+    // consecutive layers (in draw order) on the same texture and blend mode share
+    // a draw call.
+    struct QuadInstance {
+        float corners[8];   // TL, TR, BR, BL
+        float tex_rect[4];  // min.xy max.zw
+        float opacity;
+    };
+    struct BatchRun {
+        GLuint texture;
+        int blend_mode;
+        int first, count;
+    };
+    GLuint batch_vao = 0, instance_vbo = 0;
+    size_t instance_capacity = 0;  // Bytes allocated in instance_vbo
+    bool batching = true;
+    GlStateCache gl;               // Phase 31: every bind and draw below goes through this
+
+    // Phase 32: one layer's draw, collected by submit() and issued in a
+    // state-friendly order by draw_submitted()
+    struct DrawItem {
+        const Quad* quad;
+        FrameTextures textures;
+        TiledImage* tiled;  // Drawn with render_tiled() when set
+        const std::vector<LayerEffect>* effects;  // Phase 33
+        float opacity;
+        int blend_mode;
+        ShaderKey key;
+        float bounds[4];    // Screen-space box: min x, min y, max x, max y
+    };
+    bool reorder = true;
+    uint32_t moved_layers = 0;     // Layers drawn earlier than their z-order in the current order
+    uint32_t schedules = 0;        // Times the order was recomputed
+    uint32_t effect_compiles = 0;  // Phase 33: fused effect programs built so far
+    uint32_t skipped_draws = 0;    // Phase 32: quad draws skipped because their permutation failed to build
+    ProgramBinaryCache program_cache;  // Phase 34
     
     ProjectionRenderer() = default;
     
@@ -458,79 +5207,43 @@ public:
         if (quad_vao) glDeleteVertexArrays(1, &quad_vao);
         if (quad_vbo) glDeleteBuffers(1, &quad_vbo);
         if (quad_ebo) glDeleteBuffers(1, &quad_ebo);
-        if (shader_program) glDeleteProgram(shader_program);
+        if (batch_vao) glDeleteVertexArrays(1, &batch_vao);
+        if (instance_vbo) glDeleteBuffers(1, &instance_vbo);
+        for (ShaderVariant& variant : variants) {
+            if (variant.program) glDeleteProgram(variant.program);
+            variant.program = 0;
+        }
+        for (auto& [key, variant] : effect_variants) {
+            if (variant.program) glDeleteProgram(variant.program);
+        }
+        effect_variants.clear();
+        bound = nullptr;
     }
     
+    // Returns false if any permutation failed to build. The renderer is usable
+    // either way: quads needing a missing program are skipped and counted.
     bool init() {
-        // Simple vertex shader
-        const char* vs_src = R"(
-            #version 410 core
-            layout(location = 0) in vec2 pos;
-            layout(location = 1) in vec2 uv;
-            
-            out vec2 frag_uv;
-            
-            uniform vec2 corners[4];
-            uniform vec2 screen_size;
-            
-            void main() {
-                vec2 quad_corner = mix(mix(corners[3], corners[2], uv.x),
-                                       mix(corners[0], corners[1], uv.x), uv.y);
-                
-                vec2 ndc = (quad_corner / screen_size) * 2.0 - 1.0;
-                ndc.y = -ndc.y;  // Flip Y
-                
-                gl_Position = vec4(ndc, 0.0, 1.0);
-                frag_uv = uv;
-            }
-        )";
-        
-        // Simple fragment shader
-        const char* fs_src = R"(
-            #version 410 core
-            in vec2 frag_uv;
-            out vec4 color;
-            
-            uniform sampler2D tex;
-            uniform float opacity;
-            uniform int blend_mode;  // 0=alpha, 1=add, 2=multiply
-            uniform float brightness;
-            
-            void main() {
-                vec4 tex_color = texture(tex, frag_uv);
-                tex_color.rgb *= brightness;
-                tex_color.a *= opacity;
-                
-                if (blend_mode == 1) {
-                    // Additive blend
-                    color = vec4(tex_color.rgb, 1.0);
-                } else if (blend_mode == 2) {
-                    // Multiply blend
-                    color = vec4(tex_color.rgb, tex_color.a);
-                } else {
-                    // Alpha blend (default)
-                    color = tex_color;
+        // Phase 34: cached binaries first, source when they miss
+        auto t0 = std::chrono::steady_clock::now();
+        program_cache.open();
+
+        // Phase 32: every permutation up front, so a new layer never stalls on a compile
+        int programs = 0, failed = 0;
+        for (int instanced = 0; instanced < 2; ++instanced) {
+            for (int layout = 0; layout < ShaderKey::kLayouts; ++layout) {
+                if (instanced && layout != (int)FrameLayout::RGBA) continue;
+                for (int blend = 0; blend < ShaderKey::kBlendModes; ++blend) {
+                    ShaderKey key{blend, (FrameLayout)layout, instanced != 0};
+                    if (!compile_variant(key, variants[key.index()])) failed++;
+                    programs++;
                 }
             }
-        )";
-        
-        // Compile shaders
-        GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vs, 1, &vs_src, nullptr);
-        glCompileShader(vs);
-        
-        GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fs, 1, &fs_src, nullptr);
-        glCompileShader(fs);
-        
-        // Link program
-        shader_program = glCreateProgram();
-        glAttachShader(shader_program, vs);
-        glAttachShader(shader_program, fs);
-        glLinkProgram(shader_program);
-        
-        glDeleteShader(vs);
-        glDeleteShader(fs);
+        }
+        double startup_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        std::cout << "Shader programs: " << programs << " in " << startup_ms << " ms, " << program_cache.hits << " from cache ("
+                  << (int)(program_cache.hit_rate() * 100.0f + 0.5f) << "% hit rate, ~" << (int)program_cache.saved_ms
+                  << " ms saved)" << (program_cache.enabled ? "" : ", driver has no binary formats") << "\n";
+        if (failed) std::cerr << failed << " of " << programs << " shader program(s) failed to build\n";
         
         // Create quad mesh (unit quad 0-1)
         float vertices[] = {
@@ -557,46 +5270,560 @@ public:
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
         glEnableVertexAttribArray(1);
+
+        // Phase 30: same unit quad, plus instance attributes pointed at each run in flush_batch()
+        glGenVertexArrays(1, &batch_vao);
+        glGenBuffers(1, &instance_vbo);
+        glBindVertexArray(batch_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, quad_vbo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quad_ebo);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+        for (GLuint a = 2; a <= 5; ++a) {
+            glEnableVertexAttribArray(a);
+            glVertexAttribDivisor(a, 1);
+        }
+        batch_instances.reserve(256);
+        batch_runs.reserve(64);
+        draw_items.reserve(256);
+        draw_order.reserve(256);
         
         glBindBuffer(GL_ARRAY_BUFFER, 0);
         glBindVertexArray(0);
         
         is_initialized = true;
-        return true;
+        return failed == 0;
     }
     
     void render_quad(const Quad& q, GLuint texture, float opacity, int blend_mode, float brightness = 1.0f) {
-        if (!is_initialized || !texture) return;
+        render_quad(q, FrameTextures(texture), opacity, blend_mode, brightness);
+    }
+
+    void render_quad(const Quad& q, const FrameTextures& textures, float opacity, int blend_mode, float brightness = 1.0f,
+                     const std::vector<LayerEffect>* effects = nullptr) {
+        if (!is_initialized || !textures.valid()) return;
+        
+        if (!bind_uniforms(q, textures, opacity, blend_mode, brightness, effects)) return;
+        draw_part(0.0f, 0.0f, 1.0f, 1.0f, textures.uv[0], textures.uv[1], textures.uv[2], textures.uv[3]);
+    }
+
+    // Phase 30: whether add_to_batch() can take these textures (YUV goes through render_quad)
+    bool batchable(const FrameTextures& textures) const {
+        return batching && textures.valid() && textures.layout == FrameLayout::RGBA;
+    }
+
+    // Phase 30: Queues a layer for flush_batch(). Anything drawn another way in
+    // between must be preceded by flush_batch() to keep the layer order.
+    void add_to_batch(const Quad& q, const FrameTextures& textures, float opacity, int blend_mode, float brightness = 1.0f) {
+        if (!is_initialized || !textures.valid()) return;
+        if (!batch_instances.empty() && brightness != batch_brightness) flush_batch();
+        batch_brightness = brightness;
+        blend_mode = std::clamp(blend_mode, 0, ShaderKey::kBlendModes - 1);
+        if (!variants[ShaderKey{blend_mode, FrameLayout::RGBA, true}.index()].program) {
+            skipped_draws++;
+            return;
+        }
+
+        QuadInstance instance;
+        for (int c = 0; c < 4; ++c) {
+            instance.corners[c * 2] = q.corners[c].x;
+            instance.corners[c * 2 + 1] = q.corners[c].y;
+        }
+        memcpy(instance.tex_rect, textures.uv, sizeof(instance.tex_rect));
+        instance.opacity = opacity;
+        if (batch_runs.empty() || batch_runs.back().texture != textures.planes[0] || batch_runs.back().blend_mode != blend_mode) {
+            batch_runs.push_back({textures.planes[0], blend_mode, (int)batch_instances.size(), 0});
+        }
+        batch_runs.back().count++;
+        batch_instances.push_back(instance);
+    }
+
+    // Phase 30: One buffer upload, then one instanced draw per run
+    void flush_batch() {
+        if (batch_instances.empty()) return;
+
+        // Orphaned every flush so the driver never waits on the previous contents
+        size_t bytes = batch_instances.size() * sizeof(QuadInstance);
+        gl.bind_array_buffer(instance_vbo);
+        instance_capacity = std::max(instance_capacity, bytes);
+        glBufferData(GL_ARRAY_BUFFER, instance_capacity, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, batch_instances.data());
+
+        gl.bind_vertex_array(batch_vao);
+        const GLsizei stride = sizeof(QuadInstance);
+        for (const BatchRun& run : batch_runs) {
+            use_variant(ShaderKey{run.blend_mode, FrameLayout::RGBA, true}, batch_brightness);
+
+            // No base instance in GL 4.1, so the attributes move to the run instead
+            size_t base = run.first * sizeof(QuadInstance);
+            glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride, (void*)(base + offsetof(QuadInstance, corners)));
+            glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, stride, (void*)(base + offsetof(QuadInstance, corners) + 4 * sizeof(float)));
+            glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, stride, (void*)(base + offsetof(QuadInstance, tex_rect)));
+            glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, stride, (void*)(base + offsetof(QuadInstance, opacity)));
+            gl.bind_texture(0, run.texture);
+            glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, run.count);
+            gl.count_draw();
+        }
+
+        batch_instances.clear();
+        batch_runs.clear();
+    }
+
+    // Phase 26: Draws a tiled still from the pyramid level matching the quad's
+    // on-screen size. On-screen tiles are marked wanted for the importer to
+    // stream; until one is resident, the same area of the nearest resident
+    // coarser tile is drawn in its place. `target_size` is the render target in
+    // quad coordinates and `pixel_scale` its pixels per unit.
+    void render_tiled(const Quad& q, TiledImage& image, ImVec2 target_size, ImVec2 pixel_scale, float opacity,
+                      int blend_mode, float brightness = 1.0f, const std::vector<LayerEffect>* effects = nullptr) {
+        if (!is_initialized || image.levels.empty()) return;
+
+        float qw, qh;
+        q.projected_size(qw, qh);
+        int level_idx = image.level_for(qw * pixel_scale.x, qh * pixel_scale.y);
+        image.last_level = level_idx;
+
+        if (!bind_uniforms(q, FrameTextures(image.top().tiles[0].texture.get()), opacity, blend_mode, brightness, effects)) return;
+        TiledImage::Level& level = image.levels[level_idx];
+        for (TiledImage::Tile& tile : level.tiles) {
+            float rect[4] = {(float)tile.px / level.width, (float)tile.py / level.height,
+                             (float)(tile.px + tile.w) / level.width, (float)(tile.py + tile.h) / level.height};
+            if (!part_on_screen(q, rect, target_size)) continue;
+            tile.wanted = true;
+            tile.last_used = image.frame;
+
+            // Top level is always resident, so this ends with a texture
+            int source_level = level_idx;
+            TiledImage::Tile* source = &tile;
+            while (!source->texture && source_level + 1 < (int)image.levels.size()) {
+                source_level++;
+                source = &image.tile_at(source_level, (rect[0] + rect[2]) * 0.5f, (rect[1] + rect[3]) * 0.5f);
+            }
+            if (!source->texture) continue;
+            source->last_used = image.frame;
+
+            float tex[4];
+            image.tile_tex_rect(image.levels[source_level], *source, rect, tex);
+            gl.bind_texture(0, source->texture.get());
+            draw_part(rect[0], rect[1], rect[2], rect[3], tex[0], tex[1], tex[2], tex[3]);
+        }
+    }
+
+    // Phase 32: Queues a layer, bottom to top. Nothing is drawn until draw_submitted().
+    void submit(const Quad& q, const FrameTextures& textures, TiledImage* tiled, float opacity, int blend_mode,
+                const std::vector<LayerEffect>* effects = nullptr) {
+        if (!is_initialized || (!tiled && !textures.valid())) return;
+        DrawItem item{&q, textures, tiled, effects, opacity, std::clamp(blend_mode, 0, ShaderKey::kBlendModes - 1), ShaderKey(), {}};
+        item.key.blend_mode = item.blend_mode;
+        item.key.layout = tiled ? FrameLayout::RGBA : textures.layout;
+        item.key.effects = effects ? effect_structure(*effects) : 0;
+        item.key.instanced = !tiled && !item.key.effects && batchable(textures);
+        item.bounds[0] = item.bounds[2] = q.corners[0].x;
+        item.bounds[1] = item.bounds[3] = q.corners[0].y;
+        for (int c = 1; c < 4; ++c) {
+            item.bounds[0] = std::min(item.bounds[0], q.corners[c].x);
+            item.bounds[1] = std::min(item.bounds[1], q.corners[c].y);
+            item.bounds[2] = std::max(item.bounds[2], q.corners[c].x);
+            item.bounds[3] = std::max(item.bounds[3], q.corners[c].y);
+        }
+        draw_items.push_back(item);
+    }
+
+    // Phase 33: fused effect programs currently cached
+    int effect_programs() const { return (int)effect_variants.size(); }
+
+    // Phase 32: Draws everything submitted this frame. Layers are grouped by
+    // shader permutation and texture where that can't change the picture; the
+    // order is recomputed only when the layers' keys, textures or boxes change.
+    // Phase 26: tiled stills are culled and levelled against `target_size`
+    // (quad coordinates) at `pixel_scale` pixels per unit.
+    void draw_submitted(float brightness, ImVec2 target_size, ImVec2 pixel_scale) {
+        uint64_t signature = fnv1a64((const uint8_t*)&reorder, sizeof(reorder));
+        for (const DrawItem& item : draw_items) {
+            int key = item.key.index();
+            signature = fnv1a64((const uint8_t*)&key, sizeof(key), signature);
+            signature = fnv1a64((const uint8_t*)&item.key.effects, sizeof(item.key.effects), signature);
+            signature = fnv1a64((const uint8_t*)&item.textures.planes[0], sizeof(GLuint), signature);
+            signature = fnv1a64((const uint8_t*)item.bounds, sizeof(item.bounds), signature);
+        }
+        if (signature != order_signature || draw_order.size() != draw_items.size()) {
+            schedule();
+            order_signature = signature;
+        }
+
+        for (int idx : draw_order) {
+            const DrawItem& item = draw_items[idx];
+            if (item.key.instanced) {
+                add_to_batch(*item.quad, item.textures, item.opacity, item.blend_mode, brightness);
+                continue;
+            }
+            flush_batch();
+            if (item.tiled) {
+                render_tiled(*item.quad, *item.tiled, target_size, pixel_scale, item.opacity, item.blend_mode, brightness,
+                             item.effects);
+            } else {
+                render_quad(*item.quad, item.textures, item.opacity, item.blend_mode, brightness, item.effects);
+            }
+        }
+        flush_batch();
+        draw_items.clear();
+    }
+
+private:
+    static constexpr int kScheduleWindow = 256;  // Earlier draws a layer is checked against
+
+    // Phase 32: Two layers can swap if their boxes don't meet, or if both add
+    // (or both multiply): those blends are commutative.
+    static bool must_stay_ordered(const DrawItem& a, const DrawItem& b) {
+        bool overlap = a.bounds[0] < b.bounds[2] && b.bounds[0] < a.bounds[2] &&
+                       a.bounds[1] < b.bounds[3] && b.bounds[1] < a.bounds[3];
+        return overlap && !(a.blend_mode == b.blend_mode && a.blend_mode != 0);
+    }
+
+    // Each layer in z-order joins the latest earlier draw with the same
+    // permutation and texture (else the same permutation) it can legally move
+    // next to; otherwise it goes last.
+    void schedule() {
+        draw_order.clear();
+        moved_layers = 0;
+        schedules++;
+        for (int j = 0; j < (int)draw_items.size(); ++j) {
+            const DrawItem& item = draw_items[j];
+            int insert_at = (int)draw_order.size();
+            if (reorder) {
+                int same_key = -1;
+                int stop = std::max(0, (int)draw_order.size() - kScheduleWindow);
+                for (int k = (int)draw_order.size() - 1; k >= stop; --k) {
+                    const DrawItem& other = draw_items[draw_order[k]];
+                    if (other.key == item.key && other.textures.planes[0] == item.textures.planes[0] && !other.tiled && !item.tiled) {
+                        same_key = -1;
+                        insert_at = k + 1;
+                        break;
+                    }
+                    if (same_key < 0 && other.key == item.key) same_key = k;
+                    if (must_stay_ordered(other, item)) break;
+                }
+                if (same_key >= 0) insert_at = same_key + 1;
+            }
+            if (insert_at < (int)draw_order.size()) moved_layers++;
+            draw_order.insert(draw_order.begin() + insert_at, j);
+        }
+    }
+
+    // Phase 26: whether the bounding box of part of a quad (0-1 rect) meets the screen
+    static bool part_on_screen(const Quad& q, const float rect[4], ImVec2 screen) {
+        auto point = [&](float s, float t) {
+            ImVec2 bottom(q.corners[3].x + (q.corners[2].x - q.corners[3].x) * s, q.corners[3].y + (q.corners[2].y - q.corners[3].y) * s);
+            ImVec2 top(q.corners[0].x + (q.corners[1].x - q.corners[0].x) * s, q.corners[0].y + (q.corners[1].y - q.corners[0].y) * s);
+            return ImVec2(bottom.x + (top.x - bottom.x) * t, bottom.y + (top.y - bottom.y) * t);
+        };
+        ImVec2 p[4] = {point(rect[0], rect[1]), point(rect[2], rect[1]), point(rect[2], rect[3]), point(rect[0], rect[3])};
+        float min_x = p[0].x, max_x = p[0].x, min_y = p[0].y, max_y = p[0].y;
+        for (int i = 1; i < 4; ++i) {
+            min_x = std::min(min_x, p[i].x);
+            max_x = std::max(max_x, p[i].x);
+            min_y = std::min(min_y, p[i].y);
+            max_y = std::max(max_y, p[i].y);
+        }
+        return max_x >= 0.0f && min_x <= screen.x && max_y >= 0.0f && min_y <= screen.y;
+    }
+
+    void draw_part(float qx0, float qy0, float qx1, float qy1, float tx0, float ty0, float tx1, float ty1) {
+        const UniformLocations& loc = bound->uniforms;
+        glUniform4f(loc.quad_rect, qx0, qy0, qx1, qy1);
+        glUniform4f(loc.tex_rect, tx0, ty0, tx1, ty1);
+        gl.count_uniforms(2);
+        gl.bind_vertex_array(quad_vao);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        gl.count_draw();
+    }
+
+    // Phase 32: shared by every permutation; the #version and #defines come first
+    static constexpr const char* kVertexSource = R"(
+            layout(location = 0) in vec2 pos;
+            layout(location = 1) in vec2 uv;
+            
+            out vec2 frag_uv;
+            out vec2 frag_local;  // Phase 33: position across the whole quad, 0-1
+            
+            uniform vec2 screen_size;
+        #if INSTANCED
+            // Phase 30: per-instance corners, texture rect and opacity
+            layout(location = 2) in vec4 corners_top;     // TL.xy, TR.xy
+            layout(location = 3) in vec4 corners_bottom;  // BR.xy, BL.xy
+            layout(location = 4) in vec4 tex_rect;
+            layout(location = 5) in float opacity;
+            flat out float frag_opacity;
+        #else
+            uniform vec2 corners[4];
+            uniform vec4 quad_rect;  // Phase 26: part of the quad drawn (a tile), min.xy max.zw
+            uniform vec4 tex_rect;   // Phase 26: texture coordinates across that part
+        #endif
+            
+            void main() {
+        #if INSTANCED
+                vec2 quad_corner = mix(mix(corners_bottom.zw, corners_bottom.xy, uv.x),
+                                       mix(corners_top.xy, corners_top.zw, uv.x), uv.y);
+                frag_opacity = opacity;
+                frag_local = uv;
+        #else
+                vec2 q = mix(quad_rect.xy, quad_rect.zw, uv);
+                vec2 quad_corner = mix(mix(corners[3], corners[2], q.x),
+                                       mix(corners[0], corners[1], q.x), q.y);
+                frag_local = q;
+        #endif
+                
+                vec2 ndc = (quad_corner / screen_size) * 2.0 - 1.0;
+                ndc.y = -ndc.y;  // Flip Y
+                
+                gl_Position = vec4(ndc, 0.0, 1.0);
+                frag_uv = mix(tex_rect.xy, tex_rect.zw, uv);
+            }
+    )";
         
-        glUseProgram(shader_program);
+    static constexpr const char* kFragmentSource = R"(
+            in vec2 frag_uv;
+            in vec2 frag_local;
+            out vec4 color;
+            
+            uniform sampler2D tex;    // RGBA, or the Y plane
+            uniform float brightness;
+        #if INSTANCED
+            flat in float frag_opacity;
+            #define OPACITY frag_opacity
+        #else
+            uniform float opacity;
+            #define OPACITY opacity
+        #endif
+        #if FRAME_LAYOUT != 0
+            uniform sampler2D tex_u;  // U plane, or interleaved UV for NV12
+            uniform sampler2D tex_v;  // V plane
+            uniform mat3 yuv_matrix;
+            uniform vec3 yuv_offset;
+        #endif
+
+            vec4 sample_frame(vec2 uv) {
+        #if FRAME_LAYOUT == 0
+                return texture(tex, uv);
+        #else
+                vec3 yuv;
+                yuv.x = texture(tex, uv).r;
+        #if FRAME_LAYOUT == 1
+                yuv.yz = vec2(texture(tex_u, uv).r, texture(tex_v, uv).r);
+        #else
+                yuv.yz = texture(tex_u, uv).rg;
+        #endif
+                return vec4(clamp(yuv_matrix * (yuv - yuv_offset), 0.0, 1.0), 1.0);
+        #endif
+            }
+            
+        #if EFFECTS
+            vec4 fx_chain(vec2 uv, vec2 local);  // Phase 33: effect_chain_source(), appended after this
+        #endif
+            
+            void main() {
+        #if EFFECTS
+                vec4 tex_color = fx_chain(frag_uv, frag_local);
+        #else
+                vec4 tex_color = sample_frame(frag_uv);
+        #endif
+                tex_color.rgb *= brightness;
+                tex_color.a *= OPACITY;
+        #if BLEND_MODE == 2
+                tex_color.rgb *= tex_color.a;  // Multiply blends premultiplied colour
+        #endif
+                color = tex_color;
+            }
+    )";
+
+    // Phase 32: `header` (#version and #defines) goes ahead of both sources;
+    // Phase 33: `fs_extra` (the effect chain) after the fragment source.
+    // Phase 34: loaded from program_cache when it has it. 0 on compile or link errors, which are logged.
+    GLuint build_program(const char* header, const char* vs_src, const char* fs_src, const char* fs_extra = "") {
+        const char* all_parts[4] = {header, vs_src, fs_src, fs_extra};
+        uint64_t cache_key = program_cache.key_for(all_parts, 4);
+        if (GLuint program = program_cache.load(cache_key)) return program;
+
+        auto t0 = std::chrono::steady_clock::now();
+        const char* vs_parts[2] = {header, vs_src};
+        GLuint vs = compile_shader(GL_VERTEX_SHADER, vs_parts, 2);
+        const char* fs_parts[3] = {header, fs_src, fs_extra};
+        GLuint fs = compile_shader(GL_FRAGMENT_SHADER, fs_parts, 3);
+        if (!vs || !fs) {
+            if (vs) glDeleteShader(vs);
+            if (fs) glDeleteShader(fs);
+            return 0;
+        }
+
+        GLuint program = glCreateProgram();
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glAttachShader(program, vs);
+        glAttachShader(program, fs);
+        glLinkProgram(program);
+        glDeleteShader(vs);
+        glDeleteShader(fs);
+
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            char log[1024] = {};
+            glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+            std::cerr << "Shader link failed:\n" << log << "\n";
+            glDeleteProgram(program);
+            return 0;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        program_cache.compile_ms += ms;
+        program_cache.store(cache_key, program, ms);
+        return program;
+    }
+
+    static GLuint compile_shader(GLenum type, const char* const* parts, int count) {
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, count, parts, nullptr);
+        glCompileShader(shader);
+        GLint compiled = GL_FALSE;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+        if (!compiled) {
+            char log[1024] = {};
+            glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+            std::cerr << (type == GL_VERTEX_SHADER ? "Vertex" : "Fragment") << " shader compile failed:\n" << log << "\n";
+            glDeleteShader(shader);
+            return 0;
+        }
+        return shader;
+    }
+
+    struct UniformLocations {
+        GLint corners = -1, screen_size = -1, quad_rect = -1, tex_rect = -1;
+        GLint opacity = -1, brightness = -1;
+        GLint yuv_matrix = -1, yuv_offset = -1;
+        GLint samplers[3] = {-1, -1, -1};
+        GLint fx_params = -1, fx_color = -1;  // Phase 33
+    };
+    struct ShaderVariant {
+        GLuint program = 0;
+        UniformLocations uniforms;
+        float brightness = -1.0f;  // Last value uploaded; uniforms persist with the program
+    };
+    ShaderVariant variants[ShaderKey::kCount];
+    std::unordered_map<uint64_t, ShaderVariant> effect_variants;  // Phase 33: (structure << 8) | index()
+    ShaderVariant* bound = nullptr;
+    std::vector<QuadInstance> batch_instances;  // Reused every frame
+    std::vector<BatchRun> batch_runs;
+    float batch_brightness = 1.0f;
+    std::vector<DrawItem> draw_items;           // Phase 32: this frame's layers, z-order
+    std::vector<int> draw_order;                // Phase 32: indices into draw_items, as drawn
+    uint64_t order_signature = 0;
+
+    // Builds one permutation and looks up its uniform locations
+    bool compile_variant(ShaderKey key, ShaderVariant& variant) {
+        char header[160];
+        snprintf(header, sizeof(header), "#version 410 core\n#define INSTANCED %d\n#define FRAME_LAYOUT %d\n#define BLEND_MODE %d\n#define EFFECTS %d\n",
+                 key.instanced ? 1 : 0, (int)key.layout, key.blend_mode, key.effects ? 1 : 0);
+        std::string effects = key.effects ? effect_chain_source(key.effects) : std::string();
+        variant.program = build_program(header, kVertexSource, kFragmentSource, effects.c_str());
+        if (!variant.program) return false;
+
+        UniformLocations& loc = variant.uniforms;
+        loc.corners = glGetUniformLocation(variant.program, "corners");
+        loc.screen_size = glGetUniformLocation(variant.program, "screen_size");
+        loc.quad_rect = glGetUniformLocation(variant.program, "quad_rect");
+        loc.tex_rect = glGetUniformLocation(variant.program, "tex_rect");
+        loc.opacity = glGetUniformLocation(variant.program, "opacity");
+        loc.brightness = glGetUniformLocation(variant.program, "brightness");
+        loc.yuv_matrix = glGetUniformLocation(variant.program, "yuv_matrix");
+        loc.yuv_offset = glGetUniformLocation(variant.program, "yuv_offset");
+        loc.samplers[0] = glGetUniformLocation(variant.program, "tex");
+        loc.samplers[1] = glGetUniformLocation(variant.program, "tex_u");
+        loc.samplers[2] = glGetUniformLocation(variant.program, "tex_v");
+        loc.fx_params = glGetUniformLocation(variant.program, "fx_params");
+        loc.fx_color = glGetUniformLocation(variant.program, "fx_color");
+        return true;
+    }
+
+    // Phase 33: The program for a key. Effect chains are compiled the first
+    // time their structure is drawn and cached from then on.
+    ShaderVariant& variant_for(ShaderKey key) {
+        if (!key.effects) return variants[key.index()];
+        uint64_t cache_key = ((uint64_t)key.effects << 8) | (uint64_t)key.index();
+        auto it = effect_variants.find(cache_key);
+        if (it == effect_variants.end()) {
+            it = effect_variants.emplace(cache_key, ShaderVariant()).first;
+            compile_variant(key, it->second);
+            effect_compiles++;
+        }
+        // Phase 34: a chain that failed to build is drawn without its effects
+        if (!it->second.program) {
+            key.effects = 0;
+            return variants[key.index()];
+        }
+        return it->second;
+    }
+
+    // Phase 32: Binds a permutation with its blend state. Screen size and
+    // samplers are only sent when it was rebound, brightness when it changed.
+    const UniformLocations& use_variant(ShaderKey key, float brightness) {
+        ShaderVariant& variant = variant_for(key);
+        bound = &variant;
+        GLenum src, dst;
+        blend_factors(key.blend_mode, src, dst);
+        gl.set_blend(true, src, dst);
+        if (gl.use_program(variant.program)) {
+            glUniform2f(variant.uniforms.screen_size, ImGui::GetIO().DisplaySize.x, ImGui::GetIO().DisplaySize.y);
+            for (int p = 0; p < layout_plane_count(key.layout); ++p) glUniform1i(variant.uniforms.samplers[p], p);
+            gl.count_uniforms(1 + layout_plane_count(key.layout));
+        }
+        if (variant.brightness != brightness) {
+            glUniform1f(variant.uniforms.brightness, brightness);
+            gl.count_uniforms(1);
+            variant.brightness = brightness;
+        }
+        return variant.uniforms;
+    }
+
+    // False (and nothing bound) when the quad's permutation failed to build
+    bool bind_uniforms(const Quad& q, const FrameTextures& textures, float opacity, int blend_mode, float brightness,
+                       const std::vector<LayerEffect>* effects) {
+        ShaderKey key{std::clamp(blend_mode, 0, ShaderKey::kBlendModes - 1), textures.layout, false};
+        key.effects = effects ? effect_structure(*effects) : 0;
+        if (!variant_for(key).program) {
+            skipped_draws++;
+            return false;
+        }
+        const UniformLocations& loc = use_variant(key, brightness);
         
-        // Set up uniforms
+        // Set up uniforms (Phase 30: locations cached by init())
         ImVec2 corners[4] = {q.corners[0], q.corners[1], q.corners[2], q.corners[3]};
-        int corners_loc = glGetUniformLocation(shader_program, "corners");
-        glUniform2fv(corners_loc, 4, (float*)corners);
-        
-        int screen_size_loc = glGetUniformLocation(shader_program, "screen_size");
-        glUniform2f(screen_size_loc, ImGui::GetIO().DisplaySize.x, ImGui::GetIO().DisplaySize.y);
-        
-        int opacity_loc = glGetUniformLocation(shader_program, "opacity");
-        glUniform1f(opacity_loc, opacity);
-        
-        int blend_mode_loc = glGetUniformLocation(shader_program, "blend_mode");
-        glUniform1i(blend_mode_loc, blend_mode);
-        
-        int brightness_loc = glGetUniformLocation(shader_program, "brightness");
-        glUniform1f(brightness_loc, brightness);
-        
-        // Bind texture
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        int tex_loc = glGetUniformLocation(shader_program, "tex");
-        glUniform1i(tex_loc, 0);
+        glUniform2fv(loc.corners, 4, (float*)corners);
+        glUniform1f(loc.opacity, opacity);
+        gl.count_uniforms(2);
+
+        // Phase 33: effect parameters; only their layout is baked into the program
+        if (key.effects) {
+            float params[kMaxLayerEffects][4], colors[kMaxLayerEffects][4];
+            int stages = pack_effect_uniforms(*effects, params, colors);
+            glUniform4fv(loc.fx_params, stages, &params[0][0]);
+            glUniform4fv(loc.fx_color, stages, &colors[0][0]);
+            gl.count_uniforms(2);
+        }
+
+        // Phase 13: colour conversion for YUV sources (the layout is part of the permutation)
+        if (textures.layout != FrameLayout::RGBA) {
+            float matrix[9], offset[3];
+            yuv_to_rgb_coefficients(textures.color_matrix, textures.full_range, matrix, offset);
+            glUniformMatrix3fv(loc.yuv_matrix, 1, GL_FALSE, matrix);
+            glUniform3fv(loc.yuv_offset, 1, offset);
+            gl.count_uniforms(2);
+        }
         
-        // Render
-        glBindVertexArray(quad_vao);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        // Bind texture(s)
+        for (int p = 0; p < layout_plane_count(textures.layout); ++p) {
+            gl.bind_texture(p, textures.planes[p]);
+        }
+        return true;
     }
 };
 
@@ -607,6 +5834,8 @@ struct ShowModeController {
     float global_opacity = 1.0f;
     float seek_offset = 0.0f;  // Frame offset
     std::vector<bool> layer_overrides;  // Track per-layer visibility overrides
+    uint64_t last_render_allocs = 0;    // Phase 22: allocation counters at the previous OSD frame
+    uint64_t last_decode_allocs = 0;
     
     void update_layer_visibility(int layer_count) {
         if ((int)layer_overrides.size() != layer_count) {
@@ -621,7 +5850,7 @@ struct ShowModeController {
         return original_visible && !layer_overrides[layer_idx];
     }
     
-    void render_osd(const LayerCompositor& compositor, const MediaLibrary& media_lib) {
+    void render_osd(const LayerCompositor& compositor, const MediaLibrary& media_lib, const GlStateCache::Counters& gl_counters) {
         if (!show_osd) return;
         
         ImDrawList* draw_list = ImGui::GetForegroundDrawList();
@@ -636,34 +5865,76 @@ struct ShowModeController {
         draw_list->AddText(pos, text_color, "=== SHOW MODE ===");
         pos.y += 25;
         
+        // Phase 22: formatted into a stack buffer; the OSD runs every show frame
+        char line[160];
+
         // Brightness
-        std::string brightness_str = "Brightness: " + std::to_string((int)(brightness * 100)) + "%";
-        draw_list->AddText(pos, text_color, brightness_str.c_str());
+        snprintf(line, sizeof(line), "Brightness: %d%%", (int)(brightness * 100));
+        draw_list->AddText(pos, text_color, line);
         pos.y += 20;
         
         // Global opacity
-        std::string opacity_str = "Global Opacity: " + std::to_string((int)(global_opacity * 100)) + "%";
-        draw_list->AddText(pos, text_color, opacity_str.c_str());
+        snprintf(line, sizeof(line), "Global Opacity: %d%%", (int)(global_opacity * 100));
+        draw_list->AddText(pos, text_color, line);
         pos.y += 20;
         
         // Video info if playing
         if (media_lib.is_video_loaded) {
-            std::string video_str = "Video Frame: " + std::to_string(media_lib.video_decoder.current_frame) + 
-                                   "/" + std::to_string(media_lib.video_decoder.total_frames);
-            draw_list->AddText(pos, text_color, video_str.c_str());
+            const VideoDecoder& decoder = media_lib.preview->decoder;
+            snprintf(line, sizeof(line), "Video Frame: %d/%d", (int)decoder.current_frame.load(std::memory_order_acquire), decoder.total_frames.load());
+            draw_list->AddText(pos, text_color, line);
+            pos.y += 20;
+
+            if (decoder.worker_running) {
+                const DecodeStats& ds = decoder.stats;
+                snprintf(line, sizeof(line), "Decode Ring: %d/%d | Underruns: %llu | Ahead: %d ms", (int)ds.ring_depth,
+                         (int)ds.ring_capacity, (unsigned long long)ds.underruns, (int)(ds.decode_ahead_sec * 1000.0));
+                draw_list->AddText(pos, text_color, line);
+                pos.y += 20;
+            }
+        }
+
+        // Phase 16: streams decoding for layers, and the worst underrun count among them
+        if (!media_lib.layer_sources.empty()) {
+            uint64_t worst_underruns = 0;
+            for (const auto& source : media_lib.layer_sources) {
+                worst_underruns = std::max<uint64_t>(worst_underruns, source->decoder.stats.underruns);
+            }
+            snprintf(line, sizeof(line), "Layer Streams: %d | Worst Underruns: %llu", (int)media_lib.layer_sources.size(),
+                     (unsigned long long)worst_underruns);
+            draw_list->AddText(pos, text_color, line);
+            pos.y += 20;
+        }
+
+        // Phase 31: GL calls issued last frame, and redundant ones skipped
+        snprintf(line, sizeof(line), "GL/Frame: %u draws | %u binds | %u state | %u uniforms | %u skipped", gl_counters.draws,
+                 gl_counters.binds, gl_counters.state_changes, gl_counters.uniform_uploads, gl_counters.skipped);
+        draw_list->AddText(pos, text_color, line);
+        pos.y += 20;
+
+        // Phase 22: heap allocations per frame, when built with VIVALUX_ALLOC_TRACKING
+        if (kAllocTracking) {
+            uint64_t render_allocs = alloc_count(AllocRole::Render);
+            uint64_t decode_allocs = alloc_count(AllocRole::Decode);
+            snprintf(line, sizeof(line), "Heap Allocs/Frame: render %llu | decode %llu",
+                     (unsigned long long)(render_allocs - last_render_allocs),
+                     (unsigned long long)(decode_allocs - last_decode_allocs));
+            last_render_allocs = render_allocs;
+            last_decode_allocs = decode_allocs;
+            draw_list->AddText(pos, text_color, line);
             pos.y += 20;
         }
         
         // Layer visibility
-        std::string layer_str = "Layers (press 1-" + std::to_string(std::min(9, (int)compositor.layers.size())) + " to toggle):";
-        draw_list->AddText(pos, text_color, layer_str.c_str());
+        snprintf(line, sizeof(line), "Layers (press 1-%d to toggle):", std::min(9, (int)compositor.layers.size()));
+        draw_list->AddText(pos, text_color, line);
         pos.y += 20;
         
         for (int i = 0; i < std::min(9, (int)compositor.layers.size()); ++i) {
             const Layer& layer = compositor.layers[i];
             bool visible = is_layer_visible(i, layer.visible);
-            std::string layer_info = std::string(visible ? "[V]" : "[H]") + " " + std::to_string(i+1) + ": " + layer.name;
-            draw_list->AddText(pos, text_color, layer_info.c_str());
+            snprintf(line, sizeof(line), "%s %d: %s", visible ? "[V]" : "[H]", i + 1, layer.name);
+            draw_list->AddText(pos, text_color, line);
             pos.y += 18;
         }
         
@@ -676,8 +5947,555 @@ struct ShowModeController {
     }
 };
 
+// Phase 16: Headless decode throughput benchmark (--bench-decode <files...>).
+// Plays N copies of each file on the shared pool, consuming frames at 60 Hz
+// like the render loop, and reports how many streams sustain real time.
+// Measures decode + convert only; GPU upload is not part of this test.
+static int run_decode_benchmark(const std::vector<std::string>& files) {
+    const int stream_counts[] = {1, 2, 4, 6, 8, 12, 16};
+    const double run_seconds = 5.0;
+    const double first_frame_timeout = 10.0;  // Seconds to wait for every stream's first frame
+    const double tick = 1.0 / 60.0;
+    const double max_underrun_pct = 1.0;
+
+    if (files.empty()) {
+        std::cerr << "Usage: Vivalux --bench-decode <video> [video...]\n";
+        return 1;
+    }
+
+    DecoderPool pool;
+    pool.start(DecoderPool::default_thread_count());
+    int hw = std::max(1, (int)std::thread::hardware_concurrency());
+    std::cout << "Decode benchmark: " << pool.thread_count() << " pool threads, " << hw << " hardware threads\n";
+
+    for (const std::string& file : files) {
+        int max_sustained = 0;
+        for (int n : stream_counts) {
+            struct Stream {
+                VideoDecoder decoder;
+                double loop_start = 0.0;
+                double shown = -1.0;
+                bool looping = false;
+                uint64_t underruns = 0;
+                uint64_t decoded_before = 0;  // Frames decoded before the timed window
+            };
+            std::vector<std::unique_ptr<Stream>> streams;
+            bool opened = true;
+            for (int i = 0; i < n; ++i) {
+                auto stream = std::make_unique<Stream>();
+                if (!stream->decoder.open(file, std::max(1, hw / n))) {
+                    opened = false;
+                    break;
+                }
+                stream->decoder.start_async(pool, 4);
+                streams.push_back(std::move(stream));
+            }
+            if (!opened) {
+                std::cerr << "Cannot open " << file << "\n";
+                for (auto& stream : streams) stream->decoder.stop_async();
+                return 1;
+            }
+
+            // Codec warm-up and the first GOP are not part of the timed window
+            auto wait_start = std::chrono::steady_clock::now();
+            bool all_started = false;
+            while (!all_started) {
+                all_started = true;
+                for (auto& stream : streams) all_started = all_started && stream->decoder.ring.size() > 0;
+                if (std::chrono::duration<double>(std::chrono::steady_clock::now() - wait_start).count() > first_frame_timeout) break;
+                if (!all_started) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if (!all_started) {
+                std::cerr << "No frames from " << file << " within " << first_frame_timeout << " s\n";
+                for (auto& stream : streams) stream->decoder.stop_async();
+                return 1;
+            }
+            for (auto& stream : streams) stream->decoded_before = stream->decoder.stats.frames_decoded;
+
+            uint64_t ticks = 0;
+            auto start = std::chrono::steady_clock::now();
+            auto next_tick = start;
+            double elapsed = 0.0;
+            while (elapsed < run_seconds) {
+                std::this_thread::sleep_until(next_tick);
+                next_tick += std::chrono::microseconds((int64_t)(tick * 1e6));
+                elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                ticks++;
+
+                for (auto& stream : streams) {
+                    VideoDecoder& dec = stream->decoder;
+                    double t = elapsed - stream->loop_start;
+                    dec.clock_seconds = t;
+                    if (DecodedFrame* f = dec.select_decoded(t)) {
+                        stream->shown = f->pts_seconds;
+                        stream->looping = false;
+                        dec.release_decoded();
+                    } else if (dec.worker_eof && !stream->looping && dec.ring.size() == 0) {
+                        // Loop the clip so short files can run the full test
+                        dec.seek_to_frame(0);
+                        stream->loop_start = elapsed;
+                        stream->shown = -1.0;
+                        stream->looping = true;
+                    } else if (!stream->looping &&
+                               (stream->shown < 0.0 || t >= stream->shown + dec.frame_duration)) {
+                        stream->underruns++;
+                    }
+                }
+            }
+
+            uint64_t underruns = 0, decoded = 0;
+            for (auto& stream : streams) {
+                underruns += stream->underruns;
+                decoded += stream->decoder.stats.frames_decoded - stream->decoded_before;
+                stream->decoder.stop_async();
+            }
+            double pct = ticks ? 100.0 * (double)underruns / (double)(ticks * n) : 0.0;
+            bool sustained = pct <= max_underrun_pct;
+            std::cout << std::filesystem::path(file).filename().string() << ": " << n << " streams, "
+                      << (double)decoded / elapsed << " frames/s decoded, underruns " << pct << "%"
+                      << (sustained ? "" : "  (not sustained)") << "\n";
+            if (!sustained) break;
+            max_sustained = n;
+        }
+        std::cout << std::filesystem::path(file).filename().string() << ": max sustained streams = "
+                  << max_sustained << "\n";
+    }
+    return 0;
+}
+
+// Phase 19: Headless loop check (--verify-loop <clip> [loops] [out_frame]).
+// Loops the clip on the decode thread and consumes every frame in order,
+// failing if any frame repeats or skips on the timeline, joins included, or
+// if frame numbers don't run in - out, in - out without a break.
+static int run_loop_verification(const std::string& path, uint32_t loops, int out_frame) {
+    VideoDecoder decoder;
+    if (!decoder.open(path)) return 1;
+    decoder.loop_enabled = true;
+    decoder.loop_in = 0;
+    decoder.loop_out = out_frame;
+
+    DecoderPool pool;
+    pool.start(2);
+    decoder.start_async(pool, 4);
+
+    uint64_t frames = 0, sequence_breaks = 0;
+    int expected = -1;  // Frame number due next
+    auto last_progress = std::chrono::steady_clock::now();
+    while (decoder.stats.loops < loops) {
+        DecodedFrame* f = decoder.peek_decoded();
+        if (!f) {
+            if (std::chrono::steady_clock::now() - last_progress > std::chrono::seconds(5)) {
+                std::cerr << "Loop verification stalled after " << frames << " frames\n";
+                decoder.stop_async();
+                return 1;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            continue;
+        }
+        // Advance the clock exactly to the next frame so none is dropped
+        decoder.clock_seconds = f->pts_seconds;
+        if (expected >= 0 && f->frame_index != expected) {
+            if (sequence_breaks < 10) std::cerr << "Frame " << f->frame_index << " where " << expected << " was due\n";
+            sequence_breaks++;
+        }
+        expected = f->frame_index >= decoder.loop_end_frame() ? decoder.loop_in.load() : f->frame_index + 1;
+        decoder.select_decoded(f->pts_seconds);
+        decoder.release_decoded();
+        frames++;
+        last_progress = std::chrono::steady_clock::now();
+    }
+    decoder.stop_async();
+
+    const DecodeStats& ds = decoder.stats;
+    std::cout << "Loop verification: " << ds.loops << " loops of frames " << decoder.loop_in << ".."
+              << decoder.loop_end_frame() << ", " << frames << " frames, " << ds.loop_gaps << " gaps, "
+              << ds.loop_dups << " duplicates, " << sequence_breaks << " frame number breaks, " << ds.seeks << " seeks\n";
+    return ds.loop_gaps == 0 && ds.loop_dups == 0 && sequence_breaks == 0 ? 0 : 1;
+}
+
+// Hidden GL 4.1 core window (current, no vsync) with an ImGui context, for the
+// headless modes that draw. nullptr, with the reason printed, on failure.
+static GLFWwindow* open_headless_window(int width, int height, const char* title) {
+    if (!glfwInit()) {
+        std::cerr << "Failed to initialize GLFW\n";
+        return nullptr;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(width, height, title, nullptr, nullptr);
+    if (!window) {
+        std::cerr << "Failed to create GLFW window\n";
+        glfwTerminate();
+        return nullptr;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(0);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+        std::cerr << "Failed to initialize GLAD\n";
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return nullptr;
+    }
+    ImGui::CreateContext();  // The renderer reads the display size from ImGui
+    ImGui::GetIO().DisplaySize = ImVec2((float)width, (float)height);
+    return window;
+}
+
+// Phase 22: Headless steady-state allocation check (--verify-no-alloc <clip> [seconds]).
+// Runs the show loop's per-frame work at 60 Hz into a hidden window: the clip
+// plays looped as the preview (frame cache on) and on kLayers layers sharing one
+// source at staggered delays, uploaded through PBOs and drawn by the projection
+// renderer. Fails if the render or decode threads allocate after warm-up. The
+// UI isn't exercised; the show-mode OSD reports live counts for it.
+static int run_alloc_verification(const std::string& path, double seconds) {
+    if (!kAllocTracking) {
+        std::cerr << "Built without VIVALUX_ALLOC_TRACKING; nothing to check\n";
+        return 2;
+    }
+    set_alloc_role(AllocRole::Render);
+
+    const int width = 1280, height = 720;
+    const int kLayers = 4;
+    GLFWwindow* window = open_headless_window(width, height, "VivaLux allocation check");
+    if (!window) return 1;
+
+    int result = 1;
+    {
+        ProjectionRenderer renderer;
+        renderer.init();
+        MediaLibrary library;
+        library.video_settings.loop_playback = true;
+        library.video_settings.pbo_upload = true;
+        library.video_settings.frame_cache_mb = 64;
+
+        if (library.load_video(path)) {
+            // Layer quads side by side; the last one shows the preview
+            std::vector<Quad> quads(kLayers + 1);
+            for (int i = 0; i <= kLayers; ++i) {
+                float x = 20.0f + i * 240.0f;
+                quads[i].corners[0] = ImVec2(x, 200.0f);
+                quads[i].corners[1] = ImVec2(x + 220.0f, 200.0f);
+                quads[i].corners[2] = ImVec2(x + 220.0f, 420.0f);
+                quads[i].corners[3] = ImVec2(x, 420.0f);
+            }
+            // Two frames apart, inside one source's history, so the layers fan out from it
+            double delay_step = 2.0 * library.preview->decoder.frame_duration;
+
+            const double warmup_seconds = 3.0;  // Rings, cache, history and PBOs fill up; first loop joins
+            uint64_t render_start = 0, decode_start = 0;
+            uint64_t frames_drawn = 0;
+            bool measuring = false;
+            library.clock.play();
+            auto start = std::chrono::steady_clock::now();
+            auto next_tick = start;
+            while (true) {
+                std::this_thread::sleep_until(next_tick);
+                next_tick += std::chrono::microseconds(16667);
+                double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                if (!measuring && t >= warmup_seconds) {
+                    measuring = true;
+                    render_start = alloc_count(AllocRole::Render);
+                    decode_start = alloc_count(AllocRole::Decode);
+                }
+                if (t >= warmup_seconds + seconds) break;
+
+                // The show loop: bind, update and upload, then draw every layer
+                for (int i = 0; i < kLayers; ++i) {
+                    float w = 0.0f, h = 0.0f;
+                    quads[i].projected_size(w, h);
+                    library.bind_layer_video(i, path.c_str(), i * delay_step, true, w, h);
+                }
+                float preview_w = 0.0f, preview_h = 0.0f;
+                quads[kLayers].projected_size(preview_w, preview_h);
+                library.add_preview_footprint(preview_w, preview_h);
+                library.release_unused_layer_videos();
+                library.update_output_scales();
+                library.update_videos();
+
+                renderer.gl.begin_frame();
+                renderer.gl.set_viewport(0, 0, width, height);
+                glClear(GL_COLOR_BUFFER_BIT);
+                for (int i = 0; i < kLayers; ++i) {
+                    if (const FrameTextures* texture = library.layer_texture(i)) {
+                        renderer.submit(quads[i], *texture, nullptr, 1.0f, 0);
+                    }
+                }
+                if (library.preview->texture.valid()) renderer.submit(quads[kLayers], library.preview->texture, nullptr, 1.0f, 0);
+                renderer.draw_submitted(1.0f, ImVec2((float)width, (float)height), ImVec2(1.0f, 1.0f));
+                glfwSwapBuffers(window);
+                if (measuring) frames_drawn++;
+            }
+            uint64_t render_allocs = alloc_count(AllocRole::Render) - render_start;
+            uint64_t decode_allocs = alloc_count(AllocRole::Decode) - decode_start;
+
+            const DecodeStats& ds = library.preview->decoder.stats;
+            std::cout << "Allocation check: " << seconds << " s of playback after warm-up, " << frames_drawn
+                      << " frames drawn, " << kLayers << " layers on " << library.layer_sources.size()
+                      << " shared source(s) plus the preview (" << ds.frames_decoded << " frames decoded, " << ds.loops
+                      << " loops); render allocations " << render_allocs << ", decode allocations " << decode_allocs << "\n";
+            result = render_allocs == 0 && decode_allocs == 0 ? 0 : 1;
+        }
+    }
+
+    ImGui::DestroyContext();
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return result;
+}
+
+// Phase 23: Headless image-sequence throughput (--bench-sequence <pattern[@fps]> [max_threads]).
+// Loads the sequence with 1, 2, 4... parallel loaders on a pool of the same size
+// and consumes frames as fast as they arrive, looping, to report sustained fps.
+static int run_sequence_benchmark(const std::string& pattern, int max_threads) {
+    const double run_seconds = 5.0;
+    const double warmup_seconds = 0.5;  // Prefetch buffer filling up; not counted
+
+    std::cout << "Sequence benchmark: " << pattern << ", up to " << max_threads << " threads\n";
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        DecoderPool pool;  // Declared first so the decoder leaves it before it stops
+        pool.start(threads);
+        VideoDecoder decoder;
+        decoder.sequence_prefetch = std::max(16, threads * 2);
+        if (!decoder.open(pattern, threads)) return 1;
+        decoder.loop_enabled = true;
+        decoder.start_async(pool, 4);
+
+        uint64_t frames = 0, counted_from = 0;
+        bool counting = false;
+        auto start = std::chrono::steady_clock::now();
+        auto count_start = start;
+        double elapsed = 0.0;
+        while (elapsed < warmup_seconds + run_seconds) {
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (!counting && elapsed >= warmup_seconds) {
+                counting = true;
+                counted_from = frames;
+                count_start = std::chrono::steady_clock::now();
+            }
+            DecodedFrame* f = decoder.peek_decoded();
+            if (!f) {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                continue;
+            }
+            decoder.clock_seconds = f->pts_seconds;
+            decoder.select_decoded(f->pts_seconds);
+            decoder.release_decoded();
+            frames++;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - count_start).count();
+        double fps = (double)(frames - counted_from) / seconds;
+        decoder.stop_async();
+
+        std::cout << threads << " threads: " << fps << " fps sustained (" << fps * decoder.frame_duration
+                  << "x real time), " << decoder.sequence->last_load_ms.load() << " ms per image\n";
+    }
+    return 0;
+}
+
+// Phase 25: Headless ingest (--ingest <image|folder...>). Encodes stills into the
+// compressed texture cache without a GPU, then checks each one on the CPU: the
+// cache file must read back identically, and the decoded top level must stay
+// within a sane PSNR of the source. Alpha images are stored as BC7; a GPU
+// without BPTC re-encodes them to BC3 on first load.
+static int run_ingest(const std::vector<std::string>& inputs) {
+    const double min_psnr = 20.0;  // Well below any working encoder; catches broken blocks
+
+    if (inputs.empty()) {
+        std::cerr << "Usage: Vivalux --ingest <image|folder> [...]\n";
+        return 1;
+    }
+    std::vector<std::string> files;
+    for (const std::string& input : inputs) {
+        std::error_code ec;
+        if (!std::filesystem::is_directory(input, ec)) {
+            files.push_back(input);
+            continue;
+        }
+        for (const auto& entry : std::filesystem::directory_iterator(input, ec)) {
+            if (is_image_file(entry.path())) files.push_back(entry.path().string());
+        }
+    }
+    std::sort(files.begin(), files.end());
+
+    TextureCache cache;
+    int failures = 0;
+    size_t raw_total = 0, compressed_total = 0;
+    for (const std::string& file : files) {
+        std::vector<uint8_t> bytes;
+        int w = 0, h = 0, c = 0;
+        unsigned char* pixels = nullptr;
+        if (read_file_bytes(file.c_str(), bytes)) {
+            pixels = stbi_load_from_memory(bytes.data(), (int)bytes.size(), &w, &h, &c, 4);
+        }
+        if (!pixels) {
+            std::cerr << "Failed to load image: " << file << "\n";
+            failures++;
+            continue;
+        }
+        uint64_t hash = fnv1a64(bytes.data(), bytes.size());
+
+        auto t0 = std::chrono::steady_clock::now();
+        CompressedImage image;
+        bool cached = cache.load(hash, BlockFormat::BC7, image);
+        if (!cached) {
+            image = compress_rgba(pixels, w, h, choose_block_format(pixels, w, h, true), true);
+            if (!cache.store(hash, BlockFormat::BC7, image)) {
+                std::cerr << "Cannot write texture cache: " << cache.path_for(hash, BlockFormat::BC7) << "\n";
+                failures++;
+            }
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+        CompressedImage reread;
+        bool round_trip = reread.load(cache.path_for(hash, BlockFormat::BC7), hash) && reread.data == image.data;
+        std::vector<uint8_t> decoded = decompress_level(image, 0);
+        if (image.format == BlockFormat::BC1) {
+            for (size_t i = 0; i < (size_t)w * h; ++i) pixels[i * 4 + 3] = 255;  // BC1 is stored opaque
+        }
+        double psnr = rgba_psnr(decoded.data(), pixels, (size_t)w * h);
+        stbi_image_free(pixels);
+
+        size_t raw_bytes = (size_t)w * h * 4;
+        raw_total += raw_bytes;
+        compressed_total += image.data.size();
+        bool ok = round_trip && psnr >= min_psnr;
+        if (!ok) failures++;
+        std::cout << std::filesystem::path(file).filename().string() << ": " << block_format_name(image.format) << " "
+                  << w << "x" << h << ", " << image.levels.size() << " mips, " << image.data.size() / 1024 << " KB ("
+                  << raw_bytes / 1024 << " KB as RGBA8), " << psnr << " dB, " << (cached ? "cached" : "encoded") << " in "
+                  << ms << " ms" << (round_trip ? "" : ", cache read-back mismatch") << (ok ? "" : "  FAILED") << "\n";
+    }
+    std::cout << "Ingest: " << files.size() << " images, " << compressed_total / (1024 * 1024) << " MB compressed with mips vs "
+              << raw_total / (1024 * 1024) << " MB RGBA8 without, " << failures << " failures, cache in "
+              << cache.directory << "\n";
+    return failures == 0 ? 0 : 1;
+}
+
+// Phase 30: Draw submission benchmark (--bench-draw [max_quads] [textures]).
+// Renders a grid of quads into a hidden window once per layer through
+// render_quad() and once through the instanced batch, and reports the CPU time
+// spent submitting a frame. Quads cycle through `textures` textures in draw
+// order, so 1 is the atlas case (one draw call) and a count equal to the quads
+// is the worst case (one call per quad either way). GPU time is excluded: each
+// frame is finished outside the timed region.
+static int run_draw_benchmark(int max_quads, int texture_count) {
+    const int quad_counts[] = {1, 10, 100, 500, 1000, 2000, 5000, 10000};
+    const int frames = 100;
+    const int warmup_frames = 10;
+    const int width = 1280, height = 720;
+
+    GLFWwindow* window = open_headless_window(width, height, "VivaLux draw benchmark");
+    if (!window) return 1;
+
+    int result = 0;
+    {
+        ProjectionRenderer renderer;
+        renderer.init();
+
+        texture_count = std::max(1, texture_count);
+        std::vector<GlTexture> textures(texture_count);
+        std::vector<uint8_t> pixels(64 * 64 * 4);
+        for (int t = 0; t < texture_count; ++t) {
+            for (size_t i = 0; i < pixels.size(); ++i) pixels[i] = (uint8_t)(i * 7 + t * 31);
+            glBindTexture(GL_TEXTURE_2D, textures[t].create());
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 64, 64, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glViewport(0, 0, width, height);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+        std::cout << "Draw benchmark: " << texture_count << " texture(s), " << frames << " frames per run\n";
+        std::cout << "quads | per-layer ms | draws | batched ms | draws | speedup\n";
+        for (int count : quad_counts) {
+            if (count > max_quads) break;
+
+            // Grid of small quads covering the window
+            std::vector<Quad> quads(count);
+            int cols = (int)std::ceil(std::sqrt((double)count));
+            float cell_w = (float)width / cols, cell_h = (float)height / cols;
+            for (int i = 0; i < count; ++i) {
+                float x = (i % cols) * cell_w, y = (i / cols) * cell_h;
+                quads[i].corners[0] = ImVec2(x, y);
+                quads[i].corners[1] = ImVec2(x + cell_w * 0.9f, y);
+                quads[i].corners[2] = ImVec2(x + cell_w * 0.9f, y + cell_h * 0.9f);
+                quads[i].corners[3] = ImVec2(x, y + cell_h * 0.9f);
+            }
+
+            double ms[2] = {0.0, 0.0};
+            uint32_t draws[2] = {0, 0};
+            for (int batched = 0; batched < 2; ++batched) {
+                for (int frame = 0; frame < warmup_frames + frames; ++frame) {
+                    glClear(GL_COLOR_BUFFER_BIT);
+                    renderer.gl.begin_frame();
+                    auto t0 = std::chrono::steady_clock::now();
+                    for (int i = 0; i < count; ++i) {
+                        FrameTextures texture(textures[i % texture_count].get());
+                        if (batched) {
+                            renderer.add_to_batch(quads[i], texture, 1.0f, 0);
+                        } else {
+                            renderer.render_quad(quads[i], texture, 1.0f, 0);
+                        }
+                    }
+                    renderer.flush_batch();
+                    double frame_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+                    glFinish();
+                    if (frame >= warmup_frames) ms[batched] += frame_ms;
+                    draws[batched] = renderer.gl.frame.draws;
+                }
+                ms[batched] /= frames;
+            }
+            char line[160];
+            snprintf(line, sizeof(line), "%5d | %12.3f | %5u | %10.3f | %5u | %6.1fx", count, ms[0], draws[0], ms[1], draws[1],
+                     ms[1] > 0.0 ? ms[0] / ms[1] : 0.0);
+            std::cout << line << "\n";
+        }
+        if (glGetError() != GL_NO_ERROR) {
+            std::cerr << "GL error during the benchmark\n";
+            result = 1;
+        }
+    }
+
+    ImGui::DestroyContext();
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return result;
+}
+
 int main(int argc, char** argv)
 {
+    set_alloc_role(AllocRole::Render);  // Phase 22: this thread runs the render loop
+
+    // Phase 16: headless benchmark, no window needed
+    if (argc > 1 && std::string(argv[1]) == "--bench-decode") {
+        return run_decode_benchmark(std::vector<std::string>(argv + 2, argv + argc));
+    }
+    if (argc > 2 && std::string(argv[1]) == "--verify-loop") {
+        uint32_t loops = argc > 3 ? (uint32_t)std::stoul(argv[3]) : 1000;
+        int out_frame = argc > 4 ? std::stoi(argv[4]) : 29;  // Short loop by default
+        return run_loop_verification(argv[2], loops, out_frame);
+    }
+    if (argc > 2 && std::string(argv[1]) == "--verify-no-alloc") {
+        return run_alloc_verification(argv[2], argc > 3 ? std::stod(argv[3]) : 10.0);
+    }
+    if (argc > 2 && std::string(argv[1]) == "--bench-sequence") {
+        int hw = std::max(1, (int)std::thread::hardware_concurrency());
+        return run_sequence_benchmark(argv[2], argc > 3 ? std::stoi(argv[3]) : hw);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--ingest") {
+        return run_ingest(std::vector<std::string>(argv + 2, argv + argc));
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-draw") {
+        return run_draw_benchmark(argc > 2 ? std::stoi(argv[2]) : 10000, argc > 3 ? std::stoi(argv[3]) : 1);
+    }
+
     if (!glfwInit()) {
         std::cerr << "Failed to initialize GLFW\n";
         return -1;
@@ -747,25 +6565,37 @@ int main(int argc, char** argv)
     // Phase 8: show mode and composition rendering
     bool show_mode = false;
     ProjectionRenderer projection_renderer;
-    projection_renderer.init();
+    if (!projection_renderer.init()) {
+        std::cerr << "Projection renderer has missing shader programs; affected layers won't draw\n";
+    }
 
     // Phase 9: Show Mode live controls
     ShowModeController show_controller;
 
-    auto refresh_monitors = [&]() -> std::vector<GLFWmonitor*> {
+    // Phase 22: refreshed in place, so the per-frame update reuses the vector's storage
+    auto refresh_monitors = [&](std::vector<GLFWmonitor*>& out) {
         int count = 0;
         GLFWmonitor** mons = glfwGetMonitors(&count);
-        std::vector<GLFWmonitor*> out;
-        for (int i = 0; i < count; ++i) out.push_back(mons[i]);
-        return out;
+        out.assign(mons, mons + count);
     };
 
-    auto get_monitor_name = [&](GLFWmonitor* m)->std::string {
-        if (!m) return "<none>";
+    auto format_monitor_label = [&](GLFWmonitor* m, char* buf, size_t size) {
+        if (!m) {
+            snprintf(buf, size, "<none>");
+            return;
+        }
         const char* name = glfwGetMonitorName(m);
-        return name ? std::string(name) : std::string("Unknown");
+        const GLFWvidmode* vm = glfwGetVideoMode(m);
+        if (vm) {
+            snprintf(buf, size, "%s (%dx%d @%dHz)", name ? name : "Unknown", vm->width, vm->height, vm->refreshRate);
+        } else {
+            snprintf(buf, size, "%s", name ? name : "Unknown");
+        }
     };
 
+    std::vector<GLFWmonitor*> monitors;
+    std::vector<int> layer_indices;  // Phase 22: reused for the show-mode z-order sort
+
     // Main loop
     while (!glfwWindowShouldClose(window)) {
         glfwPollEvents();
@@ -780,7 +6610,7 @@ int main(int argc, char** argv)
         }
 
         // Update monitor list each frame (cheap): keep selection if possible
-        std::vector<GLFWmonitor*> monitors = refresh_monitors();
+        refresh_monitors(monitors);
         if (selected_monitor >= (int)monitors.size()) selected_monitor = (int)monitors.size() - 1;
         if (selected_monitor < 0) selected_monitor = 0;
 
@@ -813,26 +6643,20 @@ int main(int argc, char** argv)
             ImGui::Text("Detected monitors: %d", (int)monitors.size());
 
             // Create a combo listing monitors
-            std::vector<std::string> names;
-            for (size_t i = 0; i < monitors.size(); ++i) {
-                const GLFWvidmode* vm = glfwGetVideoMode(monitors[i]);
-                std::ostringstream ss;
-                ss << get_monitor_name(monitors[i]);
-                if (vm) ss << " (" << vm->width << "x" << vm->height << " @" << vm->refreshRate << "Hz)";
-                names.push_back(ss.str());
-            }
-
-            if (ImGui::BeginCombo("Monitor", (names.empty() ? "<none>" : names[selected_monitor].c_str()))) {
-                for (int n = 0; n < (int)names.size(); ++n) {
+            char monitor_label[192];
+            format_monitor_label(monitors.empty() ? nullptr : monitors[selected_monitor], monitor_label, sizeof(monitor_label));
+            if (ImGui::BeginCombo("Monitor", monitor_label)) {
+                for (int n = 0; n < (int)monitors.size(); ++n) {
                     bool is_selected = (selected_monitor == n);
-                    if (ImGui::Selectable(names[n].c_str(), is_selected)) selected_monitor = n;
+                    format_monitor_label(monitors[n], monitor_label, sizeof(monitor_label));
+                    if (ImGui::Selectable(monitor_label, is_selected)) selected_monitor = n;
                     if (is_selected) ImGui::SetItemDefaultFocus();
                 }
                 ImGui::EndCombo();
             }
 
             if (ImGui::Button("Refresh Monitors")) {
-                monitors = refresh_monitors();
+                refresh_monitors(monitors);
                 if (selected_monitor >= (int)monitors.size()) selected_monitor = (int)monitors.size() - 1;
             }
 
@@ -900,8 +6724,9 @@ int main(int argc, char** argv)
             // List of quads
             for (int i = 0; i < (int)quads.size(); ++i) {
                 bool is_selected = (selected_quad_idx == i);
-                std::string label = std::string(quads[i].name) + "##quad" + std::to_string(i);
-                if (ImGui::Selectable(label.c_str(), is_selected)) {
+                char label[96];
+                snprintf(label, sizeof(label), "%s##quad%d", quads[i].name, i);
+                if (ImGui::Selectable(label, is_selected)) {
                     selected_quad_idx = i;
                 }
             }
@@ -916,8 +6741,9 @@ int main(int argc, char** argv)
                 ImGui::Text("Corners:");
                 for (int i = 0; i < 4; ++i) {
                     float corners[2] = {q.corners[i].x, q.corners[i].y};
-                    std::string corner_label = "Corner " + std::to_string(i);
-                    ImGui::SliderFloat2(corner_label.c_str(), corners, 0.0f, 1280.0f);
+                    char corner_label[16];
+                    snprintf(corner_label, sizeof(corner_label), "Corner %d", i);
+                    ImGui::SliderFloat2(corner_label, corners, 0.0f, 1280.0f);
                     q.corners[i] = ImVec2(corners[0], corners[1]);
                 }
 
@@ -995,6 +6821,37 @@ int main(int argc, char** argv)
                     }
                 }
             }
+
+            // Phase 24: images (or whole folders) import in the background
+            ImageImporter& importer = media_library.importer;
+            ImGui::SliderInt("Upload Budget (KB/frame)##media", &importer.budget_kb, 256, 65536);
+            ImGui::SliderFloat("Upload Budget (ms/frame)##media", &importer.budget_ms, 0.25f, 16.0f, "%.2f");
+            // Phase 25: block compression with an on-disk cache
+            bool compress = importer.compress;
+            if (ImGui::Checkbox("Compress Stills (BC1/BC7)##media", &compress)) importer.compress = compress;
+            ImGui::SameLine();
+            ImGui::TextDisabled("cache: %u hits, %u encoded%s", importer.cache_hits.load(), importer.encoded.load(),
+                                importer.formats_queried && !importer.s3tc_supported ? ", no S3TC" : "");
+            // Phase 27: small stills share atlas pages; applies to later imports
+            int atlas_max = importer.atlas_max_size;
+            if (ImGui::SliderInt("Atlas Max Size (px, 0=off)##media", &atlas_max, 0, 1024)) {
+                importer.atlas_max_size = atlas_max;
+            }
+            const TextureAtlas& atlas = media_library.atlas;
+            if (!atlas.pages.empty()) {
+                ImGui::TextDisabled("atlas: %d stills on %d pages, %.0f%% used", atlas.entries, (int)atlas.pages.size(),
+                                    atlas.occupancy() * 100.0f);
+            }
+            // Phase 28: stills not drawn recently are evicted past this budget
+            ImGui::SliderInt("VRAM Budget (MB)##media", &media_library.vram_budget_mb, 64, 8192);
+            ImGui::TextDisabled("stills: %.1f MB resident, %.1f MB evicted (%u evictions, %u restores)",
+                                media_library.resident_bytes / (1024.0 * 1024.0), media_library.evicted_bytes / (1024.0 * 1024.0),
+                                media_library.evictions, media_library.restores);
+            size_t importing = importer.pending();
+            if (importing > 0) {
+                ImGui::Text("Importing %d | last frame %.0f KB in %.2f ms", (int)importing,
+                            importer.last_bytes / 1024.0, importer.last_ms);
+            }
             
             ImGui::InputText("Video Path##video", file_input_buffer, sizeof(file_input_buffer));
             ImGui::SameLine();
@@ -1008,37 +6865,77 @@ int main(int argc, char** argv)
                     }
                 }
             }
+            ImGui::TextDisabled("Image sequence: dir/frame_%%05d.png@24 (pattern@fps)");  // Phase 23
 
             ImGui::Separator();
 
             // List loaded textures
             if (!media_library.textures.empty()) {
-                const char* combo_preview = media_library.selected_texture.empty() ? "<none>" : media_library.selected_texture.c_str();
-                if (ImGui::BeginCombo("Texture##select", combo_preview)) {
-                    for (auto& pair : media_library.textures) {
-                        bool is_selected = (media_library.selected_texture == pair.first);
-                        if (ImGui::Selectable(pair.first.c_str(), is_selected)) {
-                            media_library.selected_texture = pair.first;
+                // Phase 29: listed by handle, so stills with the same file name stay distinct
+                TextureAsset* selected_asset = media_library.textures.get(media_library.selected_texture);
+                std::string combo_preview = selected_asset ? selected_asset->name() : "<none>";
+                if (ImGui::BeginCombo("Texture##select", combo_preview.c_str())) {
+                    media_library.textures.for_each([&](TextureHandle handle, TextureAsset& asset) {
+                        bool is_selected = (media_library.selected_texture == handle);
+                        ImGui::PushID((int)handle.index);
+                        if (ImGui::Selectable(asset.name().c_str(), is_selected)) {
+                            media_library.selected_texture = handle;
+                        }
+                        if (ImGui::IsItemHovered()) ImGui::SetTooltip("%s", asset.filepath);
+                        // Phase 28: what each still holds on the GPU
+                        ImGui::SameLine();
+                        const TextureAsset* shared = asset.source ? media_library.get(handle) : nullptr;
+                        if (shared) {
+                            ImGui::TextDisabled("(same as %s)", shared->name().c_str());
+                        } else if (asset.state == AssetState::Evicted) {
+                            ImGui::TextDisabled("(evicted, %.1f MB)", asset.evicted_bytes() / (1024.0 * 1024.0));
+                        } else if (!asset.ready()) {
+                            ImGui::TextDisabled("(%s)", asset_state_name(asset.state));
+                        } else {
+                            ImGui::TextDisabled("%.1f MB", asset.resident_bytes() / (1024.0 * 1024.0));
                         }
                         if (is_selected) ImGui::SetItemDefaultFocus();
-                    }
+                        ImGui::PopID();
+                    });
                     ImGui::EndCombo();
                 }
+                if (selected_asset) {
+                    ImGui::SameLine();
+                    if (ImGui::Button("Remove##texture") && !media_library.remove_texture(media_library.selected_texture)) {
+                        std::cerr << "Cannot remove texture while it imports\n";
+                    }
+                }
             }
 
             ImGui::Separator();
 
+            // Phase 16: clips loaded so far; the selected one plays in the preview
+            if (!media_library.clips.empty()) {
+                const char* clip_preview = media_library.selected_clip >= 0 ? media_library.clips[media_library.selected_clip].name.c_str() : "<none>";
+                if (ImGui::BeginCombo("Clip##select", clip_preview)) {
+                    for (int i = 0; i < (int)media_library.clips.size(); ++i) {
+                        bool is_selected = (media_library.selected_clip == i);
+                        if (ImGui::Selectable(media_library.clips[i].name.c_str(), is_selected) && !is_selected) {
+                            std::string clip_path = media_library.clips[i].path;
+                            media_library.load_video(clip_path);
+                        }
+                        if (is_selected) ImGui::SetItemDefaultFocus();
+                    }
+                    ImGui::EndCombo();
+                }
+            }
+
             // Display video if loaded
-            if (media_library.is_video_loaded && media_library.video_texture) {
-                ImGui::Text("Video: %s", media_library.selected_texture.c_str());
-                ImGui::Text("Resolution: %dx%d | Frames: %d", 
-                           media_library.video_decoder.width, 
-                           media_library.video_decoder.height,
-                           media_library.video_decoder.total_frames);
+            if (media_library.is_video_loaded && media_library.preview->texture.valid()) {
+                VideoSource& preview = *media_library.preview;
+                VideoDecoder& decoder = preview.decoder;
+                VideoSettings& settings = media_library.video_settings;
+                ImGui::Text("Video: %s", media_library.clips[media_library.selected_clip].name.c_str());
+                ImGui::Text("Resolution: %dx%d | Frames: %d", decoder.src_width, decoder.src_height, decoder.total_frames.load());
 
                 // Display video preview
                 float preview_size = 200.0f;
-                float aspect = (float)media_library.video_decoder.width / (float)media_library.video_decoder.height;
+                float aspect = (float)decoder.width / (float)decoder.height;
                 float preview_w = preview_size;
                 float preview_h = preview_size / aspect;
                 if (preview_h > preview_size) {
@@ -1046,27 +6943,162 @@ int main(int argc, char** argv)
                     preview_w = preview_size * aspect;
                 }
 
-                ImGui::Image((ImTextureID)(intptr_t)media_library.video_texture, ImVec2(preview_w, preview_h),
+                ImGui::Image((ImTextureID)(intptr_t)preview.texture.planes[0], ImVec2(preview_w, preview_h),
                              ImVec2(0, 1), ImVec2(1, 0));  // Flip Y for OpenGL
+                media_library.add_preview_footprint(preview_w, preview_h);
+
+                // Phase 20: decode size follows the quads (and this preview) showing the clip
+                ImGui::Checkbox("Scale To Quad Size##video", &settings.footprint_scaling);
+                ImGui::Text("Decoding at %dx%d (1/%d%s)", decoder.width, decoder.height, 1 << decoder.output_shift,
+                            decoder.codec_ctx && decoder.codec_ctx->lowres > 0 ? ", codec lowres" : "");
 
                 // Video playback controls
                 ImGui::Checkbox("Playing##video", &is_playing);
                 
-                int frame_slider = media_library.video_decoder.current_frame;
-                if (ImGui::SliderInt("Frame##video", &frame_slider, 0, media_library.video_decoder.total_frames - 1)) {
-                    media_library.video_decoder.seek_to_frame(frame_slider);
+                int frame_slider = preview.scrub_frame >= 0 ? preview.scrub_frame : (int)decoder.current_frame.load(std::memory_order_acquire);
+                if (ImGui::SliderInt("Frame##video", &frame_slider, 0, decoder.total_frames - 1)) {
+                    // Phase 18: keyframes/cached frames while dragging, exact seek otherwise
+                    if (settings.keyframe_scrub && ImGui::IsItemActive()) {
+                        media_library.scrub_video(frame_slider);
+                    } else {
+                        media_library.seek_video(frame_slider);
+                    }
+                }
+                if (settings.keyframe_scrub && ImGui::IsItemDeactivatedAfterEdit()) {
+                    media_library.seek_video(frame_slider);  // Refine to the exact frame on release
                 }
                 
-                ImGui::Text("Frame: %d / %d", media_library.video_decoder.current_frame, media_library.video_decoder.total_frames);
+                ImGui::Text("Frame: %d / %d", (int)decoder.current_frame.load(std::memory_order_acquire), decoder.total_frames.load());
+
+                // Phase 11: Clock-driven frame selection statistics
+                const DecodeStats& clock_stats = decoder.stats;
+                ImGui::Text("Clock: %.2f s | Dropped: %llu | Repeated: %llu", media_library.clock.now(),
+                            (unsigned long long)clock_stats.frames_dropped, (unsigned long long)clock_stats.frames_repeated);
+
+                // Phase 12: Seek latency for this file
+                if (clock_stats.seeks > 0) {
+                    ImGui::Text("Seek: %.1f ms (max %.1f ms, %u frames from keyframe)", clock_stats.last_seek_ms.load(),
+                                clock_stats.max_seek_ms.load(), clock_stats.last_seek_decoded.load());
+                }
+                if (decoder.sequence) {
+                    // Phase 23: parallel still loading ahead of the ring
+                    ImGui::Text("Sequence: %.2f fps | %d loaders | %d/%d frames ahead | %.1f ms/frame",
+                                decoder.sequence->fps, decoder.sequence->loader_count(), decoder.sequence->ready_count(),
+                                decoder.sequence_prefetch, decoder.sequence->last_load_ms.load());
+                } else if (decoder.index_build && !decoder.has_index()) {
+                    ImGui::TextDisabled("Building frame index: seeks snap to keyframes until done");
+                } else if (!decoder.has_index()) {
+                    ImGui::TextDisabled("No frame index: seeks snap to keyframes");
+                }
+
+                // Phase 19: gapless loop between in and out points
+                if (ImGui::Checkbox("Loop##video", &settings.loop_playback)) {
+                    media_library.apply_loop_mode();
+                }
+                if (settings.loop_playback) {
+                    int loop_in = decoder.loop_in;
+                    int loop_out = decoder.loop_end_frame();
+                    if (ImGui::SliderInt("Loop In##video", &loop_in, 0, loop_out)) decoder.loop_in = loop_in;
+                    if (ImGui::SliderInt("Loop Out##video", &loop_out, loop_in, std::max(0, decoder.total_frames - 1))) {
+                        decoder.loop_out = loop_out;
+                    }
+                    ImGui::Text("Loops: %u | Join gaps: %llu | Duplicates: %llu", decoder.stats.loops.load(),
+                                (unsigned long long)decoder.stats.loop_gaps, (unsigned long long)decoder.stats.loop_dups);
+                }
+
+                // Phase 18: scrubbing
+                ImGui::Checkbox("Keyframe Scrub##video", &settings.keyframe_scrub);
+                if (ImGui::SliderInt("Frame Cache (MB)##video", &settings.frame_cache_mb, 0, 2048)) {
+                    media_library.apply_cache_budget();
+                }
+                ImGui::Text("Cache: %d frames, %.1f MB | hits %llu, misses %llu", (int)decoder.cache.frame_count(),
+                            decoder.cache.bytes() / (1024.0 * 1024.0), (unsigned long long)decoder.cache.hits,
+                            (unsigned long long)decoder.cache.misses);
+
+                // Phase 10: Threaded decode controls and ring statistics
+                if (ImGui::Checkbox("Threaded Decode##video", &settings.async_decode)) {
+                    media_library.apply_video_settings();
+                }
+                if (decoder.worker_running) {
+                    const DecodeStats& ds = decoder.stats;
+                    ImGui::Text("Ring: %d / %d | Underruns: %llu", (int)ds.ring_depth, (int)ds.ring_capacity,
+                                (unsigned long long)ds.underruns);
+                    ImGui::Text("Decode ahead: %.1f ms | Last decode: %.2f ms", ds.decode_ahead_sec * 1000.0,
+                                ds.last_decode_ms.load());
+                } else {
+                    ImGui::SliderInt("Ring Depth##video", &settings.ring_depth, 2, 16);
+                }
+
+                // Phase 16: shared decode pool
+                ImGui::Text("Decoder pool: %d threads | %d streams", media_library.decoder_pool.thread_count(),
+                            (int)media_library.decoder_pool.task_count());
+
+                // Phase 17: shared layer decoding
+                MediaLibrary::SharingStats sharing = media_library.sharing_stats();
+                ImGui::Text("Layer videos: %d layers on %d decoders (%d suspended)", sharing.layers, sharing.sources,
+                            sharing.suspended);
+                ImGui::Text("Sharing saves: %.1f MB | %.1f ms/s decode", sharing.bytes_saved / (1024.0 * 1024.0),
+                            sharing.decode_ms_saved_per_sec);
+
+                // Phase 14: streaming uploads
+                if (ImGui::Checkbox("PBO Upload##video", &settings.pbo_upload)) {
+                    media_library.apply_video_settings();
+                }
+                ImGui::Text("Upload: %.2f ms | GPU-busy skips: %llu", preview.uploader.last_upload_ms,
+                            (unsigned long long)preview.uploader.busy_skips);
+
+                // Phase 15: decode-into-mapped-memory vs copy path
+                if (VideoSettings::mapped_decode_supported()) {
+                    if (ImGui::Checkbox("Decode Into Mapped Buffer##video", &settings.mapped_decode)) {
+                        media_library.apply_video_settings();
+                    }
+                } else {
+                    ImGui::TextDisabled("Mapped decode needs GL 4.4 buffer storage");
+                }
+                ImGui::Text("Staging cost/frame: copy %.2f ms | mapped %.2f ms", preview.staging_ms[0],
+                            preview.staging_ms[1]);
+
+                // Phase 13: native plane upload
+                if (ImGui::Checkbox("YUV Upload##video", &settings.yuv_upload)) {
+                    media_library.apply_video_settings();
+                }
+                ImGui::SameLine();
+                const FrameTextures& vt = preview.texture;
+                ImGui::TextDisabled("%s %s %s", vt.layout == FrameLayout::RGBA ? "RGBA" : vt.layout == FrameLayout::NV12 ? "NV12" : "YUV420P",
+                                    vt.layout == FrameLayout::RGBA ? "" : vt.color_matrix == 1 ? "BT.709" : "BT.601",
+                                    vt.layout == FrameLayout::RGBA ? "" : vt.full_range ? "full" : "limited");
             } else if (!media_library.is_video_loaded) {
                 TextureAsset* selected = media_library.get_selected();
-                if (selected && selected->gl_texture) {
+                if (selected) {
+                    media_library.touch(*selected);  // Phase 28: the preview counts as a use
                     ImGui::Text("Selected: %s", selected->filepath);
-                    ImGui::Text("Resolution: %dx%d", selected->width, selected->height);
+                    if (selected->ready() && selected->tiled) {
+                        // Phase 26: residency of the tile pyramid
+                        const TiledImage& tiled = *selected->tiled;
+                        size_t tile_count = 0;
+                        for (const TiledImage::Level& level : tiled.levels) tile_count += level.tiles.size();
+                        ImGui::Text("Resolution: %dx%d (tiled)", selected->width, selected->height);
+                        ImGui::Text("%s, %d levels, %d/%zu tiles resident, %.1f MB on GPU", block_format_name(selected->format),
+                                    selected->mip_levels, tiled.resident_tiles, tile_count, tiled.resident_bytes / (1024.0 * 1024.0));
+                        if (tiled.last_level >= 0) {
+                            ImGui::TextDisabled("drawn at level %d, %llu tile uploads, %llu evictions", tiled.last_level,
+                                                (unsigned long long)tiled.tile_uploads, (unsigned long long)tiled.evictions);
+                        }
+                    } else if (selected->ready()) {
+                        ImGui::Text("Resolution: %dx%d", selected->width, selected->height);
+                        ImGui::Text("%s, %d mips, %.1f MB on GPU%s", block_format_name(selected->format), selected->mip_levels,
+                                    selected->gpu_bytes / (1024.0 * 1024.0), selected->from_cache ? " (cached)" : "");
+                    } else if (selected->state == AssetState::Uploading) {
+                        // Phase 24: placeholder and progress until the import completes
+                        ImGui::ProgressBar(selected->upload_progress(), ImVec2(-1, 0), "Uploading");
+                    } else {
+                        ImGui::Text("Import: %s", asset_state_name(selected->state));
+                    }
 
                     // Display texture preview (scaled to fit in UI)
                     float preview_size = 200.0f;
-                    float aspect = (float)selected->width / (float)selected->height;
+                    bool sized = selected->size_known() && selected->height > 0;
+                    float aspect = sized ? (float)selected->width / (float)selected->height : 1.0f;
                     float preview_w = preview_size;
                     float preview_h = preview_size / aspect;
                     if (preview_h > preview_size) {
@@ -1074,8 +7106,11 @@ int main(int argc, char** argv)
                         preview_w = preview_size * aspect;
                     }
 
-                    ImGui::Image((ImTextureID)(intptr_t)selected->gl_texture, ImVec2(preview_w, preview_h),
-                                 ImVec2(0, 1), ImVec2(1, 0));  // Flip Y for OpenGL
+                    GLuint shown = selected->ready() ? selected->preview_texture() : media_library.placeholder_texture();
+                    static const float kFullUv[4] = {0.0f, 0.0f, 1.0f, 1.0f};
+                    const float* uv = selected->ready() ? selected->atlas_uv : kFullUv;
+                    ImGui::Image((ImTextureID)(intptr_t)shown, ImVec2(preview_w, preview_h),
+                                 ImVec2(uv[0], uv[3]), ImVec2(uv[2], uv[1]));  // Flip Y for OpenGL
 
                     // Playback controls
                     ImGui::Checkbox("Playing##media", &is_playing);
@@ -1090,9 +7125,34 @@ int main(int argc, char** argv)
         }
 
         // --- Phase 5: Update video playback ---
-        if (media_library.is_video_loaded && is_playing) {
-            media_library.update_video_frame();
+        // Phase 11: the master clock decides which frame is shown, so update every
+        // iteration (a paused clock simply keeps the current frame)
+        if (is_playing) media_library.clock.play(); else media_library.clock.pause();
+        // Phase 16: every visible layer with its own clip keeps a decoding source
+        // Phase 20: each one reports how large its quad is on screen
+        // Phase 21: hidden ones (including show mode overrides) keep a suspended source
+        ImVec2 fb_scale = ImGui::GetIO().DisplayFramebufferScale;
+        for (int i = 0; i < (int)compositor.layers.size(); ++i) {
+            const Layer& layer = compositor.layers[i];
+            bool visible = show_mode ? show_controller.is_layer_visible(i, layer.visible) : layer.visible;
+            if (!visible && !layer.video_path[0]) continue;
+            float footprint_w = 0.0f, footprint_h = 0.0f;
+            if (layer.quad_idx >= 0 && layer.quad_idx < (int)quads.size()) {
+                quads[layer.quad_idx].projected_size(footprint_w, footprint_h);
+                footprint_w *= fb_scale.x;
+                footprint_h *= fb_scale.y;
+            }
+            if (layer.video_path[0]) {
+                media_library.bind_layer_video(layer.id, layer.video_path, layer.video_offset, visible, footprint_w, footprint_h);
+            } else {
+                media_library.add_preview_footprint(footprint_w, footprint_h);
+            }
         }
+        media_library.release_unused_layer_videos();
+        media_library.update_output_scales();
+        media_library.update_videos();
+        media_library.upload_imports();  // Phase 24: budgeted, so large imports never stall a frame
+        media_library.enforce_vram_budget();  // Phase 28
 
         // --- Phase 6 UI: Layer Composition ---
         {
@@ -1119,8 +7179,9 @@ int main(int argc, char** argv)
                 Layer& layer = compositor.layers[i];
                 bool is_selected = (compositor.selected_layer_idx == i);
                 
-                std::string display = std::string(layer.visible ? "[V] " : "[H] ") + layer.name;
-                if (ImGui::Selectable(display.c_str(), is_selected)) {
+                char display[80];
+                snprintf(display, sizeof(display), "%s%s", layer.visible ? "[V] " : "[H] ", layer.name);
+                if (ImGui::Selectable(display, is_selected)) {
                     compositor.selected_layer_idx = i;
                 }
                 if (is_selected) ImGui::SetItemDefaultFocus();
@@ -1142,14 +7203,77 @@ int main(int argc, char** argv)
                 const char* blend_modes[] = {"Alpha", "Add", "Multiply"};
                 ImGui::Combo("Blend Mode##layer", &layer.blend_mode, blend_modes, 3);
 
-                // Quad assignment dropdown
-                if (!quads.empty()) {
-                    std::vector<std::string> quad_names;
-                    quad_names.push_back("<None>");
-                    for (size_t j = 0; j < quads.size(); ++j) {
-                        quad_names.push_back(quads[j].name);
+                // Phase 33: effect chain, fused into one shader per combination of stages
+                ImGui::Text("Effects (%d):", (int)layer.effects.size());
+                int effect_action = -1, effect_target = -1;  // 0=up, 1=down, 2=remove
+                for (int e = 0; e < (int)layer.effects.size(); ++e) {
+                    LayerEffect& effect = layer.effects[e];
+                    ImGui::PushID(e);
+                    ImGui::Checkbox(LayerEffect::type_name(effect.type), &effect.enabled);
+                    // A blur stays first (pin_blur_first()), so it and whatever follows it can't swap
+                    bool pinned = effect.type == LayerEffect::Blur;
+                    bool below_pinned = e == 1 && layer.effects[0].type == LayerEffect::Blur;
+                    if (!pinned && !below_pinned && e > 0) {
+                        ImGui::SameLine();
+                        if (ImGui::SmallButton("Up")) { effect_action = 0; effect_target = e; }
+                    }
+                    if (!pinned && e + 1 < (int)layer.effects.size()) {
+                        ImGui::SameLine();
+                        if (ImGui::SmallButton("Down")) { effect_action = 1; effect_target = e; }
+                    }
+                    ImGui::SameLine();
+                    if (ImGui::SmallButton("Remove")) { effect_action = 2; effect_target = e; }
+                    switch (effect.type) {
+                        case LayerEffect::ColorAdjust:
+                            ImGui::SliderFloat("Brightness##fx", &effect.params[0], 0.0f, 2.0f);
+                            ImGui::SliderFloat("Contrast##fx", &effect.params[1], 0.0f, 2.0f);
+                            ImGui::SliderFloat("Saturation##fx", &effect.params[2], 0.0f, 2.0f);
+                            ImGui::SliderFloat("Gamma##fx", &effect.params[3], 0.2f, 3.0f);
+                            break;
+                        case LayerEffect::ChromaKey:
+                            ImGui::ColorEdit3("Key Color##fx", effect.color);
+                            ImGui::SliderFloat("Threshold##fx", &effect.params[0], 0.0f, 0.5f);
+                            ImGui::SliderFloat("Softness##fx", &effect.params[1], 0.0f, 0.5f);
+                            break;
+                        case LayerEffect::Blur:
+                            ImGui::SliderFloat("Radius##fx", &effect.params[0], 0.0f, 32.0f);
+                            ImGui::TextDisabled("Always first: filters the frame before the other effects");
+                            break;
+                        default:  // Masks
+                            ImGui::SliderFloat2("Min##fx", &effect.params[0], 0.0f, 1.0f);
+                            ImGui::SliderFloat2("Max##fx", &effect.params[2], 0.0f, 1.0f);
+                            ImGui::SliderFloat("Feather##fx", &effect.color[0], 0.0f, 0.5f);
+                            {
+                                bool invert = effect.color[1] > 0.5f;
+                                if (ImGui::Checkbox("Invert##fx", &invert)) effect.color[1] = invert ? 1.0f : 0.0f;
+                            }
+                            break;
+                    }
+                    ImGui::PopID();
+                }
+                if (effect_action == 0 && effect_target > 0) {
+                    std::swap(layer.effects[effect_target], layer.effects[effect_target - 1]);
+                } else if (effect_action == 1 && effect_target + 1 < (int)layer.effects.size()) {
+                    std::swap(layer.effects[effect_target], layer.effects[effect_target + 1]);
+                } else if (effect_action == 2) {
+                    layer.effects.erase(layer.effects.begin() + effect_target);
+                }
+                if ((int)layer.effects.size() < kMaxLayerEffects && ImGui::BeginCombo("Add Effect##layer", "<Add Effect>")) {
+                    bool has_blur = !layer.effects.empty() && layer.effects[0].type == LayerEffect::Blur;
+                    for (int t = 0; t < LayerEffect::TypeCount; ++t) {
+                        if (t == LayerEffect::Blur && has_blur) continue;  // One per chain
+                        if (!ImGui::Selectable(LayerEffect::type_name(t))) continue;
+                        if (t == LayerEffect::Blur) {
+                            layer.effects.insert(layer.effects.begin(), LayerEffect::make(t));
+                        } else {
+                            layer.effects.push_back(LayerEffect::make(t));
+                        }
                     }
+                    ImGui::EndCombo();
+                }
 
+                // Quad assignment dropdown
+                if (!quads.empty()) {
                     const char* quad_preview = (layer.quad_idx < 0 || layer.quad_idx >= (int)quads.size()) ? "<None>" : quads[layer.quad_idx].name;
                     if (ImGui::BeginCombo("Target Quad##layer", quad_preview)) {
                         if (ImGui::Selectable("<None>", layer.quad_idx < 0)) {
@@ -1168,6 +7292,51 @@ int main(int argc, char** argv)
                     ImGui::TextDisabled("No quads available");
                 }
 
+                // Phase 29: per-layer still, held by handle
+                TextureAsset* layer_still = media_library.textures.get(layer.texture);
+                std::string still_preview = layer_still ? layer_still->name() : layer.texture_path[0] ? "<Removed>" : "<Library Selection>";
+                if (ImGui::BeginCombo("Still##layer", still_preview.c_str())) {
+                    if (ImGui::Selectable("<Library Selection>", !layer.texture_path[0])) {
+                        layer.texture = TextureHandle();
+                        layer.texture_path[0] = '\0';
+                    }
+                    media_library.textures.for_each([&](TextureHandle handle, TextureAsset& asset) {
+                        ImGui::PushID((int)handle.index);
+                        bool is_sel = (layer.texture == handle);
+                        if (ImGui::Selectable(asset.name().c_str(), is_sel)) {
+                            layer.texture = handle;
+                            strncpy(layer.texture_path, asset.filepath, sizeof(layer.texture_path) - 1);
+                            layer.texture_path[sizeof(layer.texture_path) - 1] = '\0';
+                        }
+                        if (is_sel) ImGui::SetItemDefaultFocus();
+                        ImGui::PopID();
+                    });
+                    ImGui::EndCombo();
+                }
+
+                // Phase 16: per-layer clip, decoded independently on the shared pool
+                const char* clip_preview = layer.video_path[0] ? layer.video_path : "<Library Preview>";
+                for (const auto& clip : media_library.clips) {
+                    if (clip.path == layer.video_path) clip_preview = clip.name.c_str();
+                }
+                if (ImGui::BeginCombo("Video Clip##layer", clip_preview)) {
+                    if (ImGui::Selectable("<Library Preview>", !layer.video_path[0])) {
+                        layer.video_path[0] = '\0';
+                    }
+                    for (const auto& clip : media_library.clips) {
+                        bool is_sel = (clip.path == layer.video_path);
+                        if (ImGui::Selectable(clip.name.c_str(), is_sel)) {
+                            strncpy(layer.video_path, clip.path.c_str(), sizeof(layer.video_path) - 1);
+                            layer.video_path[sizeof(layer.video_path) - 1] = '\0';
+                        }
+                        if (is_sel) ImGui::SetItemDefaultFocus();
+                    }
+                    ImGui::EndCombo();
+                }
+                if (layer.video_path[0]) {
+                    ImGui::SliderFloat("Time Offset (s)##layer", &layer.video_offset, 0.0f, 10.0f);
+                }
+
                 ImGui::Text("Z-Order: %d", layer.z_order);
 
                 // Layer reordering buttons
@@ -1230,6 +7399,10 @@ int main(int argc, char** argv)
                             // Restore from scene
                             quads = current_scene.quads;
                             compositor.layers = current_scene.layers;
+                            compositor.assign_layer_ids();
+                            for (Layer& layer : compositor.layers) {  // Phase 29: stills are saved by path
+                                if (layer.texture_path[0]) layer.texture = media_library.queue_texture(layer.texture_path, false);
+                            }
                             compositor.selected_layer_idx = -1;
                             std::cout << "Scene loaded from: " << path << "\n";
                         } else {
@@ -1262,6 +7435,15 @@ int main(int argc, char** argv)
             ImGui::Text("Show Mode Info:");
             ImGui::Text("Quads to render: %d", (int)quads.size());
             ImGui::Text("Visible layers: %d", (int)compositor.layers.size());
+            ImGui::Checkbox("Batch Layers (instanced)##show", &projection_renderer.batching);  // Phase 30
+            ImGui::Checkbox("Group Layers by Shader##show", &projection_renderer.reorder);     // Phase 32
+            ImGui::Text("Layers moved for grouping: %u", projection_renderer.moved_layers);
+            ImGui::Text("Effect programs: %d (%u compiled)", projection_renderer.effect_programs(),
+                        projection_renderer.effect_compiles);  // Phase 33
+            if (projection_renderer.skipped_draws) {
+                ImGui::TextColored(ImVec4(0.8f, 0.2f, 0.2f, 1.0f), "Quad draws skipped (shader failed to build): %u",
+                                   projection_renderer.skipped_draws);
+            }
             ImGui::TextDisabled("Press Ctrl+Shift+P to toggle");
 
             ImGui::End();
@@ -1270,7 +7452,9 @@ int main(int argc, char** argv)
         // Rendering
         int display_w, display_h;
         glfwGetFramebufferSize(window, &display_w, &display_h);
-        glViewport(0, 0, display_w, display_h);
+        GlStateCache& gl_state = projection_renderer.gl;  // Phase 31
+        gl_state.begin_frame();
+        gl_state.set_viewport(0, 0, display_w, display_h);
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
@@ -1349,12 +7533,9 @@ int main(int argc, char** argv)
             }
             o_pressed_last = o_pressed;
             
-            // Phase 8: Render composition to quads
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
+            // Phase 8: Render composition to quads (Phase 32: blend state set per shader permutation)
             // Sort and render layers by z-order
-            std::vector<int> layer_indices;
+            layer_indices.clear();
             for (int i = 0; i < (int)compositor.layers.size(); ++i) {
                 layer_indices.push_back(i);
             }
@@ -1370,31 +7551,56 @@ int main(int argc, char** argv)
                 }
 
                 const Quad& quad = quads[layer.quad_idx];
-                GLuint texture = 0;
+                FrameTextures texture;
+                // Phase 21: un-hidden since the sources were updated; its upload bypassed the state cache
+                if (media_library.resume_layer_video(layer.id)) gl_state.invalidate_textures();
 
-                // Get texture from media library (simplified: use video if playing, else selected)
-                if (media_library.is_video_loaded && media_library.video_texture) {
-                    texture = media_library.video_texture;
+                // Get texture from media library: the layer's own clip, else its
+                // own still, else the preview video if playing, else the selected still
+                TextureAsset* asset = nullptr;
+                if (const FrameTextures* layer_texture = media_library.layer_texture(layer.id)) {
+                    texture = *layer_texture;
+                } else if (layer.texture) {
+                    asset = media_library.get(layer.texture);  // Phase 29: nullptr (nothing drawn) once removed
+                } else if (media_library.is_video_loaded && media_library.preview->texture.valid()) {
+                    texture = media_library.preview->texture;
                 } else {
-                    TextureAsset* asset = media_library.get_selected();
-                    if (asset && asset->gl_texture) texture = asset->gl_texture;
+                    asset = media_library.get_selected();
+                }
+                if (asset) {
+                    media_library.touch(*asset);  // Phase 28: keeps it resident, or brings it back
+                    if (asset && asset->ready()) {  // Phase 24: nothing until imported
+                        if (asset->tiled) {
+                            // Phase 26: streamed per tile at the quad's on-screen size
+                            float final_opacity = layer.opacity * show_controller.global_opacity;
+                            projection_renderer.submit(quad, FrameTextures(), asset->tiled.get(), final_opacity, layer.blend_mode,
+                                                       &layer.effects);
+                            continue;
+                        }
+                        texture = FrameTextures(asset->preview_texture());
+                        memcpy(texture.uv, asset->atlas_uv, sizeof(texture.uv));  // Phase 27: atlas sub-rectangle
+                    }
                 }
 
-                if (texture) {
+                if (texture.valid()) {
                     float final_opacity = layer.opacity * show_controller.global_opacity;
-                    projection_renderer.render_quad(quad, texture, final_opacity, layer.blend_mode, show_controller.brightness);
+                    projection_renderer.submit(quad, texture, nullptr, final_opacity, layer.blend_mode, &layer.effects);
                 }
             }
+            // Phase 32: grouped by permutation and texture; RGBA runs drawn instanced (Phase 30)
+            projection_renderer.draw_submitted(show_controller.brightness, ImGui::GetIO().DisplaySize,
+                                               ImGui::GetIO().DisplayFramebufferScale);
 
-            glDisable(GL_BLEND);
+            gl_state.set_blend(false);
             
             // Phase 9: Render OSD overlay
             ImGui_ImplOpenGL3_NewFrame();
             ImGui_ImplGlfw_NewFrame();
             ImGui::NewFrame();
-            show_controller.render_osd(compositor, media_library);
+            show_controller.render_osd(compositor, media_library, gl_state.last_frame);
             ImGui::Render();
             ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+            gl_state.invalidate();  // Phase 31: the backend sets its own state
 
             // ESC to exit show mode
             if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
@@ -1406,6 +7612,7 @@ int main(int argc, char** argv)
             // Render ImGui UI
             ImGui::Render();
             ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+            gl_state.invalidate();  // Phase 31: the backend sets its own state
         }
 
         // (Platform windows / multi-viewport disabled in this build)